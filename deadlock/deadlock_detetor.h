@@ -3,13 +3,20 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <unistd.h>
 #include <pthread.h>
+#include <execinfo.h>
+#include <errno.h>
+#include <sys/syscall.h>
 
+#include <atomic>
+#include <algorithm>
 #include <deque>
 #include <vector>
 #include <map>
+#include <set>
 #include <memory>
 
 #include "backward.hpp"
@@ -19,6 +26,45 @@
 
 using namespace backward;
 
+#ifdef __linux__
+#define gettid() syscall(__NR_gettid)
+#else
+#define gettid() syscall(SYS_gettid)
+#endif
+
+// 加锁前只记录调用栈的返回地址（定长数组，不分配内存），发现死锁时才解析成文件名、函数名、行号
+struct lock_stack_t
+{
+    enum { max_frames = 32 };
+
+    void *frames[max_frames];
+    int depth;
+
+    lock_stack_t()
+        : depth(0)
+        {}
+
+    void capture()
+    {
+        depth = backtrace(frames, max_frames);
+    }
+};
+
+// 用记录下来的地址填充 backward 的 StackTrace，交给 TraceResolver 解析
+class captured_stacktrace_t : public StackTrace
+{
+public:
+    explicit captured_stacktrace_t(const lock_stack_t &stack)
+    {
+        // 除了第一帧，backtrace 拿到的都是返回地址，减一落回 call 指令，解析出的行号才是调用所在的行
+        for(int i = 0; i < stack.depth; ++i)
+        {
+            uintptr_t addr = reinterpret_cast<uintptr_t>(stack.frames[i]);
+            _stacktrace.push_back(reinterpret_cast<void *>(i == 0 ? addr : addr - 1));
+        }
+        skip_n_firsts(0);
+    }
+};
 
 struct thread_graphic_vertex_t
 {
@@ -30,49 +76,280 @@ struct thread_graphic_vertex_t
         {}
 };
 
+/*
+    每个线程一条记录，线程第一次加锁时在 DeadLockGraphic 的数组里占一个槽位，之后只写自己的槽位：
+    1）正在申请的锁、已持有的锁都是原子变量，加锁、解锁路径上没有全局锁，线程之间不会互相等待
+    2）检测线程逐个读取槽位拼出快照，各线程的状态不是同一时刻的，但死锁中的线程都阻塞在加锁上，状态不再变化，不会漏报
+    3）调用栈按 seqlock 发布：写之前和写完后各把 stack_seq 加一，读的一方看到奇数或前后不一致就丢弃这次读取
+    4）按缓存行对齐，相邻线程的槽位不会伪共享
+*/
+struct alignas(64) thread_lock_record_t
+{
+    enum { max_held = 16 };     // 同时持有更多的锁时只记录前 16 把
+
+    std::atomic<uint64_t> thread_id;    // 0 表示槽位空闲
+    std::atomic<uint64_t> apply_lock;   // 正在申请的锁，0 表示没有
+    std::atomic<uint32_t> held_count;
+    std::atomic<uint64_t> held_locks[max_held];
+
+    std::atomic<uint32_t> stack_seq;    // 每次申请加 2，也用来区分同一线程的不同次申请
+    std::atomic<int> stack_depth;
+    std::atomic<void *> stack_frames[lock_stack_t::max_frames];
+
+    std::atomic<uint32_t> reported_seq; // 已经报告过死锁的那次申请，同一个死锁只报告一次
+
+    thread_lock_record_t()
+        : thread_id(0), apply_lock(0), held_count(0), stack_seq(0), stack_depth(0), reported_seq(0)
+    {
+        for(int i = 0; i < max_held; ++i)
+        {
+            held_locks[i].store(0, std::memory_order_relaxed);
+        }
+        for(int i = 0; i < lock_stack_t::max_frames; ++i)
+        {
+            stack_frames[i].store(NULL, std::memory_order_relaxed);
+        }
+    }
+
+    // 只由所属线程调用：先写调用栈，再发布申请的锁
+    void publish_apply(uint64_t lock_addr, const lock_stack_t &stack)
+    {
+        uint32_t seq = stack_seq.load(std::memory_order_relaxed);
+        stack_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        stack_depth.store(stack.depth, std::memory_order_relaxed);
+        for(int i = 0; i < stack.depth; ++i)
+        {
+            stack_frames[i].store(stack.frames[i], std::memory_order_relaxed);
+        }
+        stack_seq.store(seq + 2, std::memory_order_release);
+        apply_lock.store(lock_addr, std::memory_order_release);
+    }
+
+    // 先清掉申请再登记持有，检测线程不会看到“线程在等自己持有的锁”；apply_lock 只有本线程写，没有申请（无竞争加锁）时不用写
+    void acquired(uint64_t lock_addr)
+    {
+        if(apply_lock.load(std::memory_order_relaxed) != 0)
+        {
+            apply_lock.store(0, std::memory_order_release);
+        }
+
+        uint32_t n = held_count.load(std::memory_order_relaxed);
+        if(n < max_held)
+        {
+            held_locks[n].store(lock_addr, std::memory_order_relaxed);
+            held_count.store(n + 1, std::memory_order_release);
+        }
+    }
+
+    // 阻塞加锁失败（EDEADLK、EINVAL 等）时撤销申请，否则槽位一直显示在等这把锁
+    void cancel_apply()
+    {
+        apply_lock.store(0, std::memory_order_release);
+    }
+
+    // 解锁顺序不一定和加锁相反，找到后用最后一个填补
+    void released(uint64_t lock_addr)
+    {
+        uint32_t n = held_count.load(std::memory_order_relaxed);
+        for(uint32_t i = n; i-- > 0; )
+        {
+            if(held_locks[i].load(std::memory_order_relaxed) == lock_addr)
+            {
+                held_locks[i].store(held_locks[n - 1].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                held_count.store(n - 1, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    // 检测线程调用：读取正在申请的锁和对应的调用栈，没有申请或读的过程中被改写返回 false
+    bool read_apply(uint64_t &lock_addr, uint32_t &seq, lock_stack_t &stack) const
+    {
+        lock_addr = apply_lock.load(std::memory_order_acquire);
+        if(lock_addr == 0)
+        {
+            return false;
+        }
+
+        seq = stack_seq.load(std::memory_order_acquire);
+        if(seq & 1)
+        {
+            return false;
+        }
+        int depth = stack_depth.load(std::memory_order_relaxed);
+        stack.depth = depth < 0 ? 0 : (depth > lock_stack_t::max_frames ? lock_stack_t::max_frames : depth);
+        for(int i = 0; i < stack.depth; ++i)
+        {
+            stack.frames[i] = stack_frames[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        return stack_seq.load(std::memory_order_relaxed) == seq
+            && apply_lock.load(std::memory_order_relaxed) == lock_addr;
+    }
+
+    // 从 read_apply 读到 seq 起一直在等同一把锁
+    bool still_applying(uint64_t lock_addr, uint32_t seq) const
+    {
+        return apply_lock.load(std::memory_order_acquire) == lock_addr
+            && stack_seq.load(std::memory_order_acquire) == seq;
+    }
+
+    bool holds(uint64_t lock_addr) const
+    {
+        uint32_t n = held_count.load(std::memory_order_acquire);
+        if(n > max_held)
+        {
+            n = max_held;
+        }
+        for(uint32_t i = 0; i < n; ++i)
+        {
+            if(held_locks[i].load(std::memory_order_relaxed) == lock_addr)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void read_held(uint64_t thd_id, std::map<uint64_t, uint64_t> &lock_belong_thread) const
+    {
+        uint32_t n = held_count.load(std::memory_order_acquire);
+        if(n > max_held)
+        {
+            n = max_held;
+        }
+        for(uint32_t i = 0; i < n; ++i)
+        {
+            uint64_t lock_addr = held_locks[i].load(std::memory_order_relaxed);
+            if(lock_addr != 0)
+            {
+                lock_belong_thread[lock_addr] = thd_id;
+            }
+        }
+    }
+
+    // 线程退出时归还槽位
+    void reset()
+    {
+        apply_lock.store(0, std::memory_order_relaxed);
+        held_count.store(0, std::memory_order_relaxed);
+        thread_id.store(0, std::memory_order_release);
+    }
+};
+
+// 加锁顺序图的一条边 from -> to：持有 from 时加了 to，记录第一次出现时的线程和调用栈
+struct lock_order_edge_t
+{
+    uint64_t thread_id;
+    lock_stack_t stack;
+
+    lock_order_edge_t()
+        : thread_id(0)
+        {}
+};
+
+/*
+    每个线程缓存见过的加锁顺序边，命中时不用加全局锁
+    每条缓存的边带着两端锁的 epoch，锁销毁时只把它自己的 epoch 加一，只有涉及这把锁的缓存项失效
+*/
+struct lock_order_cache_t
+{
+    enum { size = 64 };
+
+    uint64_t from[size];
+    uint64_t to[size];
+    uint32_t from_epoch[size];
+    uint32_t to_epoch[size];
+
+    lock_order_cache_t()
+    {
+        memset(from, 0, sizeof(from));
+        memset(to, 0, sizeof(to));
+        memset(from_epoch, 0, sizeof(from_epoch));
+        memset(to_epoch, 0, sizeof(to_epoch));
+    }
+
+    static size_t index(uint64_t from_lock, uint64_t to_lock)
+    {
+        return ((from_lock ^ (to_lock * 0x9e3779b97f4a7c15ULL)) >> 4) % size;
+    }
+
+    bool hit(size_t i, uint64_t from_lock, uint64_t to_lock, uint32_t from_lock_epoch, uint32_t to_lock_epoch) const
+    {
+        return from[i] == from_lock && to[i] == to_lock
+            && from_epoch[i] == from_lock_epoch && to_epoch[i] == to_lock_epoch;
+    }
+
+    void store(size_t i, uint64_t from_lock, uint64_t to_lock, uint32_t from_lock_epoch, uint32_t to_lock_epoch)
+    {
+        from[i] = from_lock;
+        to[i] = to_lock;
+        from_epoch[i] = from_lock_epoch;
+        to_epoch[i] = to_lock_epoch;
+    }
+};
+
+// 一个正在等锁的线程，检测出死锁后按它输出：申请的锁、锁的持有者、申请时的调用栈
+struct thread_apply_t
+{
+    thread_lock_record_t *record;
+    uint64_t thread_id;
+    uint64_t lock_addr;
+    uint64_t owner_thread;
+    uint32_t seq;
+    lock_stack_t stack;
+
+    thread_apply_t()
+        : record(NULL), thread_id(0), lock_addr(0), owner_thread(0), seq(0)
+        {}
+};
+
 class DeadLockGraphic{
 
 public:
+    enum { max_threads = 1024 };    // 超出的线程不参与检测
+    enum { max_chain_depth = 16 };  // 加锁时沿持有者链最多找这么多个线程，更长的环留给周期检测
+    enum { lock_slots = 1024 };     // 锁地址按哈希分到这么多个槽，记录 epoch 和是否在加锁顺序图里
+
     static DeadLockGraphic &getInstance()
     {
         static DeadLockGraphic instance;
         return instance;
     }
 
-    void lock_before(uint64_t thread_id, uint64_t lock_addr)
+    /*
+        加锁前：记录线程申请的锁和调用栈
+        只有 trylock 失败（锁被占用）才会走到这里，只用 backtrace 记录返回地址，不做符号解析、不格式化字符串，
+        解析放到 check_dead_lock 发现死锁之后
+    */
+    void lock_before(uint64_t lock_addr)
     {
-        // 同时锁定 m_mutex_thread_apply_lock 和 m_mutex_thread_stacktrace
-        std::lock(m_mutex_thread_apply_lock, m_mutex_thread_stacktrace);
-        m_thread_apply_lock[thread_id] = lock_addr;
+        thread_lock_record_t *record = current_record();
+        if(record == NULL)
+        {
+            return;
+        }
 
-        // 展示保存堆栈信息，如果后面判断在此处发生死锁，把这里的堆栈打印出来
-        StackTrace st;
-        TraceResolver tr;
-        st.load_here(64);
-        tr.load_stacktrace(st);
+        lock_stack_t stack;
+        stack.capture();
 
-        std::stringstream st_buffer;
-        st_buffer << " thread_id " << thread_id
-                  << " apply lock_addr " << lock_addr
-                  << std::endl;
+        // 阻塞之前检查加锁顺序，真的死锁时也能先报出顺序相反
+        if(m_lock_order_check.load(std::memory_order_relaxed))
+        {
+            check_lock_order(record, lock_addr, &stack);
+        }
 
-        for (size_t i = 0; i < st.size(); ++i) {
+        record->publish_apply(lock_addr, stack);
 
-            ResolvedTrace trace = tr.resolve(st[i]);
-            st_buffer << "#" << i
-                      // << " " << trace.object_filename
-                      // << " " << trace.object_function
-                      // << " [" << trace.addr << "]"
-                      << "  " << trace.source.filename
-                      << "  " << trace.source.function
-                      << "  " << trace.source.line
-                      << std::endl;
-        }    
-    
-        //std::cout<<st_buffer.str()<<std::endl;
+        if(m_incremental.load(std::memory_order_relaxed))
         {
-            std::lock_guard<std::mutex> m1(m_mutex_thread_stacktrace,std::adopt_lock);
-            m_thread_stacktrace[thread_id] += st_buffer.str();
+            // 先写自己的申请、再读别人的申请：两个线程同时补上环的最后一条边时，
+            // 没有全序屏障的话双方都可能读到对方的旧值，谁都不报告；加了屏障至少有一方能看到完整的环
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            check_cycle(record, lock_addr, stack);
         }
     }
 
@@ -80,61 +357,91 @@ public:
         成功加锁后：
         1）从有向图中删除一条边
         2）从关系表中增加一条关系
+        trylock 直接成功时只做第 2 步，几次写本线程的槽位
     */
-    void lock_after(uint64_t thread_id, uint64_t lock_addr)
+    void lock_after(uint64_t lock_addr)
     {
-        std::lock(m_mutex_lock_belong_thread, m_mutex_thread_apply_lock, m_mutex_thread_stacktrace);
+        thread_lock_record_t *record = current_record();
+        if(record == NULL)
         {
-            std::lock_guard<std::mutex> m0(m_mutex_thread_apply_lock, std::adopt_lock);
-            m_thread_apply_lock.erase(thread_id);
+            return;
         }
 
+        // 有申请说明走过 lock_before，已经检查过加锁顺序
+        if(m_lock_order_check.load(std::memory_order_relaxed)
+            && record->apply_lock.load(std::memory_order_relaxed) == 0)
         {
-            std::lock_guard<std::mutex> m1(m_mutex_thread_stacktrace, std::adopt_lock);
-            m_thread_stacktrace.erase(thread_id);
+            check_lock_order(record, lock_addr, NULL);
         }
+        record->acquired(lock_addr);
+    }
 
+    // 加锁出错：撤销本线程的申请，本线程同时只会申请一把锁，不需要锁地址
+    void lock_failed()
+    {
+        thread_lock_record_t *record = current_record();
+        if(record != NULL)
         {
-            std::lock_guard<std::mutex> m2(m_mutex_lock_belong_thread, std::adopt_lock);
-            m_lock_belong_thread[lock_addr] = thread_id;
+            record->cancel_apply();
         }
     }
 
-    void unlock_after(uint64_t thread_id, uint64_t lock_addr)
+    void unlock_after(uint64_t lock_addr)
     {
-        std::lock_guard<std::mutex> m(m_mutex_lock_belong_thread);
-        m_lock_belong_thread.erase(lock_addr);
+        thread_lock_record_t *record = current_record();
+        if(record != NULL)
+        {
+            record->released(lock_addr);
+        }
     }
 
+    /*
+        锁销毁后地址可能被新锁复用，从加锁顺序图中删掉，避免把新锁和旧锁的顺序混在一起
+        DL_Mutex 可能是静态对象，析构时单例也许已经析构（或者从来没有创建），这时什么都不做
+    */
+    static void lock_destroyed(uint64_t lock_addr)
+    {
+        if(instance_state().load(std::memory_order_acquire) == instance_alive)
+        {
+            getInstance().remove_lock_order(lock_addr);
+        }
+    }
+
+    // 全量检测：读取所有线程的槽位，构建等待图，拓扑排序后剩下的就是环
     void check_dead_lock()
     {
         std::map<uint64_t, uint64_t> lock_belong_thread;
-        std::map<uint64_t, uint64_t> thread_apply_lock;
-        std::map<uint64_t, std::string> thread_stacktrace;
+        std::map<uint64_t, thread_apply_t> thread_apply;
 
-        std::lock(m_mutex_lock_belong_thread, m_mutex_thread_apply_lock, m_mutex_thread_stacktrace);
+        // 逐个读取线程的槽位，拼出锁关系表和有向图
+        size_t record_count = m_record_count.load(std::memory_order_acquire);
+        for(size_t i = 0; i < record_count; ++i)
         {
-            std::lock_guard<std::mutex> m0(m_mutex_thread_apply_lock, std::adopt_lock);
-            lock_belong_thread = m_lock_belong_thread;
-        }
+            thread_lock_record_t &record = m_records[i];
+            uint64_t thd_id = record.thread_id.load(std::memory_order_acquire);
+            if(thd_id == 0)
+            {
+                continue;
+            }
 
-        {
-            std::lock_guard<std::mutex> m1(m_mutex_thread_stacktrace, std::adopt_lock);
-            thread_apply_lock = m_thread_apply_lock;
-        }
+            record.read_held(thd_id, lock_belong_thread);
 
-        {
-            std::lock_guard<std::mutex> m2(m_mutex_lock_belong_thread, std::adopt_lock);
-            thread_stacktrace = m_thread_stacktrace;
+            thread_apply_t apply;
+            apply.record = &record;
+            apply.thread_id = thd_id;
+            if(record.read_apply(apply.lock_addr, apply.seq, apply.stack))
+            {
+                thread_apply[thd_id] = apply;
+            }
         }
 
         // 构建有向图，邻接链表
         std::map<uint64_t, thread_graphic_vertex_t> graphics;
-        for(auto it = thread_apply_lock.begin();
-                    it != thread_apply_lock.end();  ++it)
+        for(auto it = thread_apply.begin();
+                    it != thread_apply.end();  ++it)
         {
             uint64_t thd_id1 = it->first;
-            uint64_t lock_id = it->second;
+            uint64_t lock_id = it->second.lock_addr;
             if(lock_belong_thread.find(lock_id) == lock_belong_thread.end())
             {
                 continue;   // 如果这个锁没有被其他线程持有，则跳过
@@ -142,6 +449,7 @@ public:
 
             // 锁的持有线程
             uint64_t thd_id2 = lock_belong_thread[lock_id];
+            it->second.owner_thread = thd_id2;
 
             if(graphics.find(thd_id1) == graphics.end())
             {
@@ -159,10 +467,7 @@ public:
             graphics[thd_id2].indegress++;
         }
 
-        int graphicsSize = graphics.size();
-
         // 拓扑排序，入度为0 的节点先入队
-        uint64_t counter = 0;
         std::deque<uint64_t> graphics_queue;
         for(auto it = graphics.begin(); it != graphics.end(); ++it)
         {
@@ -171,7 +476,6 @@ public:
             if(gvert.indegress == 0)
             {
                 graphics_queue.push_back(thd_id);
-                ++counter;
             }
         }
 
@@ -192,29 +496,34 @@ public:
                 if(graphics[thd_id2].indegress == 0)
                 {
                     graphics_queue.push_back(thd_id2);
-                    counter++;
                 }
             }
             // 删除入度为 0 的点
             graphics.erase(thd_id);
         }
 
-        if(counter != graphics.size())
+        /*
+            删不掉的点都在环上：每个线程最多等一把锁，出度不超过 1，环的下游也只能是环
+            快照不是同一时刻拼出来的，报告前对照各线程的槽位重新确认环上的两种边，任何一条变了就等下一轮：
+            1）线程仍在等同一把锁（同一次申请）
+            2）这把锁仍被快照里的持有者持有（持有者也在环上，一定在 thread_apply 里）
+        */
+        std::vector<thread_apply_t> threads;
+        bool confirmed = !graphics.empty();
+        for(auto it = graphics.begin(); confirmed && it != graphics.end(); ++it)
         {
-            printf("[ERROR!]: Found Dead Lock!!! \n");
-            for(auto it = graphics.begin(); it != graphics.end(); ++it)
-            {
-                uint64_t thd_id = it->first;
-                spdlog::info(thread_stacktrace[thd_id]);
-                
-                std::stringstream lock_belong_info;
-                lock_belong_info << " The lock addr " << thread_apply_lock[thd_id]
-                  << " is owned by " << lock_belong_thread[thread_apply_lock[thd_id]]
-                  << std::endl;
-                spdlog::info(lock_belong_info.str());
-
-                m_file_logger->flush();
-            }
+            const thread_apply_t &apply = thread_apply[it->first];
+            auto owner = thread_apply.find(apply.owner_thread);
+            confirmed = apply.record->still_applying(apply.lock_addr, apply.seq)
+                && owner != thread_apply.end()
+                && owner->second.record->thread_id.load(std::memory_order_acquire) == apply.owner_thread
+                && owner->second.record->holds(apply.lock_addr);
+            threads.push_back(apply);
+        }
+
+        if(confirmed)
+        {
+            report_dead_lock(threads);
         }
         else
         {
@@ -222,44 +531,501 @@ public:
         }
     }
 
-    void start_check()
+    /*
+        启动死锁检测：
+        1）incremental 为 true 时，线程因为锁被占用开始等待时立即沿持有者链检查，形成环的那一刻就能报告
+        2）每 interval_seconds 秒做一次全量检测兜底（持有者链超过 max_chain_depth 等情况），为 0 时不启动检测线程
+    */
+    void start_check(unsigned int interval_seconds = 10, bool incremental = true)
     {
+        m_incremental.store(incremental, std::memory_order_relaxed);
+        if(interval_seconds == 0)
+        {
+            return;
+        }
+
+        m_check_interval = interval_seconds;
         pthread_t tid;
         pthread_create(&tid, NULL, thread_rountine, (void*)(this));
     }
 
+    /*
+        启动加锁顺序检查（类似内核的 lockdep）：
+        记录“持有 A 时加 B”的边，新边让顺序图出现环时立即报告，两处调用栈一起输出，不需要真的发生死锁
+        每次加锁都要检查当前持有的锁，开销比死锁检测大，适合压测环境
+    */
+    void start_lock_order_check()
+    {
+        m_lock_order_check.store(true, std::memory_order_relaxed);
+    }
+
     static void* thread_rountine(void *args)
     {
         DeadLockGraphic *ptr_graphics = static_cast<DeadLockGraphic *>(args);
         while(1)
         {
-            sleep(10);
+            sleep(ptr_graphics->m_check_interval);
             ptr_graphics->check_dead_lock();
         }
     }
 
 private:
 
-    // 锁关系表: <threadid, 锁地址>
-    std::mutex m_mutex_lock_belong_thread;
-    std::map<uint64_t, uint64_t> m_lock_belong_thread;
+    /*
+        当前线程开始等待 lock_addr：沿“锁的持有者 -> 持有者在等的锁”往下找，回到当前线程说明这条边让等待图出现了环
+        其他线程的状态可能正在变化，找到环后再逐个确认链上的线程仍在等同一把锁、仍持有上一个线程在等的锁
+    */
+    void check_cycle(thread_lock_record_t *self, uint64_t lock_addr, const lock_stack_t &stack)
+    {
+        thread_lock_record_t *hops[max_chain_depth];
+        uint64_t hop_locks[max_chain_depth];
+        uint32_t hop_seqs[max_chain_depth];
+        int count = 0;
 
-    // 有向图: <threadid, 锁地址>
-    std::mutex m_mutex_thread_apply_lock;
-    std::map<uint64_t, uint64_t> m_thread_apply_lock;
+        uint64_t wait_lock = lock_addr;
+        for(;;)
+        {
+            thread_lock_record_t *owner = find_owner(wait_lock);
+            if(owner == NULL)
+            {
+                return;     // 持有者已经释放，马上就能拿到锁
+            }
+            if(owner == self)
+            {
+                // 重复加自己持有的锁：检错锁会返回 EDEADLK，不一定真的死锁，留给周期检测确认
+                if(count == 0)
+                {
+                    return;
+                }
+                break;
+            }
+            if(count == max_chain_depth)
+            {
+                return;
+            }
 
-    // 使用锁的调用堆栈: <>
-    std::mutex m_mutex_thread_stacktrace;
-    std::map<uint64_t, std::string> m_thread_stacktrace;
+            uint64_t next = owner->apply_lock.load(std::memory_order_acquire);
+            uint32_t seq = owner->stack_seq.load(std::memory_order_acquire);
+            if(next == 0 || (seq & 1))
+            {
+                return;     // 持有者没有在等锁，链到这里断开
+            }
+            hops[count] = owner;
+            hop_locks[count] = next;
+            hop_seqs[count] = seq;
+            ++count;
+            wait_lock = next;
+        }
+
+        std::vector<thread_apply_t> threads(count + 1);
+        threads[0].record = self;
+        threads[0].thread_id = self->thread_id.load(std::memory_order_relaxed);
+        threads[0].lock_addr = lock_addr;
+        threads[0].seq = self->stack_seq.load(std::memory_order_relaxed);
+        threads[0].stack = stack;
+
+        for(int i = 0; i < count; ++i)
+        {
+            thread_apply_t &apply = threads[i + 1];
+            apply.record = hops[i];
+            apply.thread_id = hops[i]->thread_id.load(std::memory_order_acquire);
+            if(!hops[i]->read_apply(apply.lock_addr, apply.seq, apply.stack)
+                || apply.lock_addr != hop_locks[i] || apply.seq != hop_seqs[i]
+                || !hops[i]->holds(threads[i].lock_addr))
+            {
+                return;
+            }
+        }
+
+        for(int i = 0; i <= count; ++i)
+        {
+            threads[i].owner_thread = threads[(i + 1) % (count + 1)].thread_id;
+        }
+        report_dead_lock(threads);
+    }
+
+    // 当前线程持有的每一把锁到 lock_addr 都是一条加锁顺序边；stack 是已经取好的调用栈，为 NULL 时遇到新边再取
+    void check_lock_order(thread_lock_record_t *record, uint64_t lock_addr, const lock_stack_t *stack)
+    {
+        uint32_t n = record->held_count.load(std::memory_order_relaxed);
+        if(n > thread_lock_record_t::max_held)
+        {
+            n = thread_lock_record_t::max_held;
+        }
+        for(uint32_t i = 0; i < n; ++i)
+        {
+            uint64_t held_lock = record->held_locks[i].load(std::memory_order_relaxed);
+            if(held_lock != lock_addr)
+            {
+                add_lock_order(record->thread_id.load(std::memory_order_relaxed), held_lock, lock_addr, stack);
+            }
+        }
+    }
+
+    /*
+        登记边 from -> to：
+        1）先查本线程的缓存，见过的边直接返回，稳定运行后几乎都命中
+        2）没见过时加全局锁查顺序图，新边在锁外取调用栈（lock_before 已经取过就直接用），再加锁找有没有 to -> ... -> from 的路径，
+           有就是顺序相反，把报告要用的边拷出来，释放锁之后再解析调用栈、输出；新边照样加入，之后同样的顺序不会再次报告
+    */
+    void add_lock_order(uint64_t thread_id, uint64_t from, uint64_t to, const lock_stack_t *stack)
+    {
+        static thread_local lock_order_cache_t cache;
+        size_t index = lock_order_cache_t::index(from, to);
+        uint32_t from_epoch = m_lock_epoch[lock_slot(from)].load(std::memory_order_acquire);
+        uint32_t to_epoch = m_lock_epoch[lock_slot(to)].load(std::memory_order_acquire);
+        if(cache.hit(index, from, to, from_epoch, to_epoch))
+        {
+            return;
+        }
+
+        bool known;
+        {
+            std::lock_guard<std::mutex> guard(m_mutex_lock_order);
+            auto edges = m_lock_order.find(from);
+            known = edges != m_lock_order.end() && edges->second.find(to) != edges->second.end();
+        }
+
+        if(!known)
+        {
+            lock_order_edge_t edge;
+            edge.thread_id = thread_id;
+            if(stack != NULL)
+            {
+                edge.stack = *stack;
+            }
+            else
+            {
+                edge.stack.capture();
+            }
+
+            std::vector<uint64_t> path;
+            std::vector<lock_order_edge_t> path_edges;
+            bool inversion = false;
+            {
+                std::lock_guard<std::mutex> guard(m_mutex_lock_order);
+                std::map<uint64_t, lock_order_edge_t> &edges = m_lock_order[from];
+                if(edges.find(to) == edges.end())
+                {
+                    inversion = find_lock_order_path(to, from, path);
+                    for(size_t i = 0; inversion && i + 1 < path.size(); ++i)
+                    {
+                        path_edges.push_back(m_lock_order[path[i]][path[i + 1]]);
+                    }
+                    edges[to] = edge;
+                    m_lock_order_in[to].insert(from);
+                    m_lock_in_graph[lock_slot(from)].store(true, std::memory_order_release);
+                    m_lock_in_graph[lock_slot(to)].store(true, std::memory_order_release);
+                }
+            }
+
+            if(inversion)
+            {
+                report_lock_inversion(from, to, edge, path, path_edges);
+            }
+        }
+
+        cache.store(index, from, to, from_epoch, to_epoch);
+    }
+
+    /*
+        只删除这把锁自己的出边和入边：出边在 m_lock_order[lock_addr]，入边的起点在 m_lock_order_in[lock_addr]
+        这把锁的哈希槽从来没有进过顺序图时不用加锁，绝大多数锁（从没和别的锁嵌套过）走这条路
+    */
+    void remove_lock_order(uint64_t lock_addr)
+    {
+        if(!m_lock_order_check.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+
+        size_t slot = lock_slot(lock_addr);
+        if(!m_lock_in_graph[slot].load(std::memory_order_acquire))
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> guard(m_mutex_lock_order);
+        auto out = m_lock_order.find(lock_addr);
+        if(out != m_lock_order.end())
+        {
+            for(auto it = out->second.begin(); it != out->second.end(); ++it)
+            {
+                m_lock_order_in[it->first].erase(lock_addr);
+            }
+            m_lock_order.erase(out);
+        }
+
+        auto in = m_lock_order_in.find(lock_addr);
+        if(in != m_lock_order_in.end())
+        {
+            for(auto it = in->second.begin(); it != in->second.end(); ++it)
+            {
+                m_lock_order[*it].erase(lock_addr);
+            }
+            m_lock_order_in.erase(in);
+        }
+
+        // 缓存里涉及这把锁的边全部失效
+        m_lock_epoch[slot].fetch_add(1, std::memory_order_release);
+    }
+
+    static size_t lock_slot(uint64_t lock_addr)
+    {
+        return static_cast<size_t>((lock_addr * 0x9e3779b97f4a7c15ULL) >> 54) % lock_slots;
+    }
+
+    // 在加锁顺序图中广度优先找 from 到 to 的路径，找到时 path 依次是路径上的锁，调用时持有 m_mutex_lock_order
+    bool find_lock_order_path(uint64_t from, uint64_t to, std::vector<uint64_t> &path)
+    {
+        std::map<uint64_t, uint64_t> parent;
+        std::deque<uint64_t> lock_queue;
+        parent[from] = from;
+        lock_queue.push_back(from);
+
+        while(!lock_queue.empty())
+        {
+            uint64_t lock_id = lock_queue.front();
+            lock_queue.pop_front();
+            if(lock_id == to)
+            {
+                for(uint64_t it = to; it != from; it = parent[it])
+                {
+                    path.push_back(it);
+                }
+                path.push_back(from);
+                std::reverse(path.begin(), path.end());
+                return true;
+            }
+
+            auto edges = m_lock_order.find(lock_id);
+            if(edges == m_lock_order.end())
+            {
+                continue;
+            }
+            for(auto it = edges->second.begin(); it != edges->second.end(); ++it)
+            {
+                if(parent.find(it->first) == parent.end())
+                {
+                    parent[it->first] = lock_id;
+                    lock_queue.push_back(it->first);
+                }
+            }
+        }
+        return false;
+    }
+
+    // 输出新边和已有的反向路径上每条边第一次出现时的调用栈，调用时不持有 m_mutex_lock_order
+    void report_lock_inversion(uint64_t from, uint64_t to, const lock_order_edge_t &edge,
+                               const std::vector<uint64_t> &path, const std::vector<lock_order_edge_t> &path_edges)
+    {
+        printf("[ERROR!]: Found Lock Order Inversion!!! \n");
+
+        std::stringstream title;
+        title << " thread_id " << edge.thread_id
+              << " acquire lock_addr " << to
+              << " while holding lock_addr " << from;
+        spdlog::info(format_stacktrace(title.str(), edge.stack));
+
+        for(size_t i = 0; i + 1 < path.size(); ++i)
+        {
+            const lock_order_edge_t &prev = path_edges[i];
+            std::stringstream prev_title;
+            prev_title << " previously thread_id " << prev.thread_id
+                       << " acquire lock_addr " << path[i + 1]
+                       << " while holding lock_addr " << path[i];
+            spdlog::info(format_stacktrace(prev_title.str(), prev.stack));
+        }
+        m_file_logger->flush();
+    }
+
+    // 持有 lock_addr 的线程的槽位，只在锁被占用时调用
+    thread_lock_record_t *find_owner(uint64_t lock_addr)
+    {
+        size_t record_count = m_record_count.load(std::memory_order_acquire);
+        for(size_t i = 0; i < record_count; ++i)
+        {
+            if(m_records[i].thread_id.load(std::memory_order_acquire) != 0 && m_records[i].holds(lock_addr))
+            {
+                return &m_records[i];
+            }
+        }
+        return NULL;
+    }
+
+    // 输出环上每个线程申请的锁、持有者和调用栈；环上的线程这次申请都报告过时不再重复输出
+    void report_dead_lock(const std::vector<thread_apply_t> &threads)
+    {
+        bool reported = true;
+        for(size_t i = 0; i < threads.size(); ++i)
+        {
+            if(threads[i].record->reported_seq.load(std::memory_order_relaxed) != threads[i].seq)
+            {
+                reported = false;
+            }
+        }
+        if(reported)
+        {
+            return;
+        }
+
+        printf("[ERROR!]: Found Dead Lock!!! \n");
+        for(size_t i = 0; i < threads.size(); ++i)
+        {
+            const thread_apply_t &apply = threads[i];
+            spdlog::info(format_stacktrace(apply.thread_id, apply.lock_addr, apply.stack));
+
+            std::stringstream lock_belong_info;
+            lock_belong_info << " The lock addr " << apply.lock_addr
+              << " is owned by " << apply.owner_thread
+              << std::endl;
+            spdlog::info(lock_belong_info.str());
+
+            m_file_logger->flush();
+            apply.record->reported_seq.store(apply.seq, std::memory_order_relaxed);
+        }
+    }
+
+    // 把记录的地址解析成可读的调用栈，只在发现死锁时调用
+    static std::string format_stacktrace(uint64_t thread_id, uint64_t lock_addr, const lock_stack_t &stack)
+    {
+        std::stringstream title;
+        title << " thread_id " << thread_id
+              << " apply lock_addr " << lock_addr;
+        return format_stacktrace(title.str(), stack);
+    }
+
+    static std::string format_stacktrace(const std::string &title, const lock_stack_t &stack)
+    {
+        captured_stacktrace_t st(stack);
+        TraceResolver tr;
+        tr.load_stacktrace(st);
+
+        std::stringstream st_buffer;
+        st_buffer << title << std::endl;
+
+        for (size_t i = 0; i < st.size(); ++i) {
+
+            ResolvedTrace trace = tr.resolve(st[i]);
+            st_buffer << "#" << i;
+            if(!trace.source.filename.empty())
+            {
+                st_buffer << "  " << trace.source.filename
+                          << "  " << trace.source.function
+                          << "  " << trace.source.line;
+            }
+            else
+            {
+                // 没有调试信息（没有启用 libdw 等）时只能给出所在的模块和符号
+                st_buffer << "  " << trace.object_filename
+                          << "  " << trace.object_function
+                          << " [" << trace.addr << "]";
+            }
+            st_buffer << std::endl;
+        }
+        return st_buffer.str();
+    }
+
+    // 线程退出时由 thread_local 的析构归还槽位
+    struct thread_slot_t
+    {
+        thread_lock_record_t *record;
+        bool claimed;
+
+        thread_slot_t()
+            : record(NULL), claimed(false)
+            {}
+
+        ~thread_slot_t()
+        {
+            if(record != NULL)
+            {
+                record->reset();
+            }
+        }
+    };
+
+    // 当前线程的槽位，第一次调用时占用一个空闲槽位；槽位用完返回 NULL，之后不再尝试
+    thread_lock_record_t *current_record()
+    {
+        static thread_local thread_slot_t slot;
+        if(!slot.claimed)
+        {
+            slot.claimed = true;
+            slot.record = claim_record(gettid());
+        }
+        return slot.record;
+    }
+
+    thread_lock_record_t *claim_record(uint64_t thread_id)
+    {
+        for(size_t i = 0; i < max_threads; ++i)
+        {
+            uint64_t expected = 0;
+            if(m_records[i].thread_id.load(std::memory_order_relaxed) == 0
+                && m_records[i].thread_id.compare_exchange_strong(expected, thread_id, std::memory_order_acq_rel))
+            {
+                // 检测线程只遍历用到过的槽位
+                size_t count = m_record_count.load(std::memory_order_relaxed);
+                while(count < i + 1
+                    && !m_record_count.compare_exchange_weak(count, i + 1, std::memory_order_release))
+                {
+                }
+                return &m_records[i];
+            }
+        }
+        return NULL;
+    }
+
+    // 每个线程一个槽位，m_record_count 是用到过的最大下标 + 1
+    thread_lock_record_t m_records[max_threads];
+    std::atomic<size_t> m_record_count;
+
+    std::atomic<bool> m_incremental;
+    unsigned int m_check_interval;
+
+    // 加锁顺序图: <锁地址, <后加的锁地址, 边>>，反向索引: <锁地址, 先加的锁地址>，只在出现新边、销毁锁时加锁修改
+    std::atomic<bool> m_lock_order_check;
+    std::mutex m_mutex_lock_order;
+    std::map<uint64_t, std::map<uint64_t, lock_order_edge_t> > m_lock_order;
+    std::map<uint64_t, std::set<uint64_t> > m_lock_order_in;
+    std::atomic<uint32_t> m_lock_epoch[lock_slots];
+    std::atomic<bool> m_lock_in_graph[lock_slots];
+
+    enum { instance_none, instance_alive, instance_dead };
+
+    // 常量初始化、析构什么都不做，任何静态对象析构时读取都是安全的
+    static std::atomic<int> &instance_state()
+    {
+        static std::atomic<int> state(instance_none);
+        return state;
+    }
 
     std::shared_ptr<spdlog::logger> m_file_logger;
 
     DeadLockGraphic()
+        : m_record_count(0), m_incremental(false), m_check_interval(10),
+          m_lock_order_check(false)
     {
+        for(size_t i = 0; i < lock_slots; ++i)
+        {
+            m_lock_epoch[i].store(0, std::memory_order_relaxed);
+            m_lock_in_graph[i].store(false, std::memory_order_relaxed);
+        }
+
         m_file_logger = spdlog::basic_logger_mt("basic_logger", "logs/basic.txt");
         spdlog::set_default_logger(m_file_logger);
+
+        // 第一次调用 backtrace 会加载 libgcc_s 并分配内存，先在这里调用一次，不要发生在加锁路径上
+        lock_stack_t warm_up;
+        warm_up.capture();
+
+        instance_state().store(instance_alive, std::memory_order_release);
+    }
+    ~DeadLockGraphic()
+    {
+        instance_state().store(instance_dead, std::memory_order_release);
     }
-    ~DeadLockGraphic() = default;
     DeadLockGraphic(const DeadLockGraphic &) = default;
     DeadLockGraphic& operator=(const DeadLockGraphic &) = default;
 };
@@ -267,28 +1033,40 @@ private:
 
 // for C
 
-#include <sys/syscall.h>
-
-#ifdef __linux__
-#define gettid() syscall(__NR_gettid)
-#else
-#define gettid() syscall(SYS_gettid)
-#endif
-
-// 用宏拦截 lock，添加 lock_before、lock_after 等操作，记录锁与线程的关系
+/*
+    用宏拦截 lock，添加 lock_before、lock_after 等操作，记录锁与线程的关系
+    先 trylock：成功说明没有竞争，不可能在这里死锁，只登记持有关系；
+    锁被占用（EBUSY）时才记录申请和调用栈，再阻塞加锁，加锁出错时撤销申请
+    robust 锁返回 EOWNERDEAD 时同样拿到了锁，按加锁成功登记
+*/
 #define pthread_mutex_lock(x)                                                                       \
     do {                                                                                            \
-        DeadLockGraphic::getInstance().lock_before(gettid(), reinterpret_cast<uint64_t>(x));        \
-        pthread_mutex_lock(x);                                                                      \
-        DeadLockGraphic::getInstance().lock_after(gettid(), reinterpret_cast<uint64_t>(x));         \
-    } while(false); 
+        int dl_lock_ret = pthread_mutex_trylock(x);                                                 \
+        if(dl_lock_ret == EBUSY)                                                                    \
+        {                                                                                           \
+            DeadLockGraphic::getInstance().lock_before(reinterpret_cast<uint64_t>(x));              \
+            dl_lock_ret = pthread_mutex_lock(x);                                                    \
+            if(dl_lock_ret != 0 && dl_lock_ret != EOWNERDEAD)                                       \
+            {                                                                                       \
+                DeadLockGraphic::getInstance().lock_failed();                                       \
+            }                                                                                       \
+        }                                                                                           \
+        if(dl_lock_ret == 0 || dl_lock_ret == EOWNERDEAD)                                           \
+        {                                                                                           \
+            DeadLockGraphic::getInstance().lock_after(reinterpret_cast<uint64_t>(x));               \
+        }                                                                                           \
+    } while(false)
+
+// 拦截 destroy，从加锁顺序图中删掉这把锁；写成逗号表达式，返回值不变
+#define pthread_mutex_destroy(x)                                                                    \
+    (DeadLockGraphic::lock_destroyed(reinterpret_cast<uint64_t>(x)), pthread_mutex_destroy(x))
 
 // 拦截 unlock，添加 unlock_after，删除锁关系
 #define pthread_mutex_unlock(x)                                                                     \
     do {                                                                                            \
         pthread_mutex_unlock(x);                                                                    \
-        DeadLockGraphic::getInstance().unlock_after(gettid(), reinterpret_cast<uint64_t>(x));       \
-    } while(false);
+        DeadLockGraphic::getInstance().unlock_after(reinterpret_cast<uint64_t>(x));                 \
+    } while(false)
 
 // for cpp
 namespace std{
@@ -298,6 +1076,9 @@ class DL_Mutex{
         DL_Mutex(){
             m_mutex = PTHREAD_MUTEX_INITIALIZER;
         }
+        ~DL_Mutex(){
+            pthread_mutex_destroy(&m_mutex);
+        }
         void Lock(){
             pthread_mutex_lock(&m_mutex);
         }
@@ -64,6 +64,8 @@ int main()
 {
     // *) 添加该行， 表示启动死锁检测功能 
     DeadLockGraphic::getInstance().start_check();
+    // *) 可选，检查加锁顺序，顺序相反时立即报告，不需要等到真的死锁
+    DeadLockGraphic::getInstance().start_lock_order_check();
 
     DeadLockCreater dlc;
 
@@ -0,0 +1,133 @@
+#ifndef __POLLER_H__
+#define __POLLER_H__
+
+#include <climits>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+
+/*
+    Reactor 使用的 IO 多路复用后端：登记 fd，等待事件或到达截止时间
+    1）事件掩码统一用 EPOLLIN / EPOLLOUT / EPOLLERR 等，io_uring 的 poll 掩码和它数值相同
+    2）截止时间是 steady_clock（CLOCK_MONOTONIC）的绝对纳秒数，-1 表示一直等
+    3）每个 fd 带一个 64 位的 data，事件原样带回
+*/
+
+enum class PollerBackend : uint8_t
+{
+    Epoll,
+    IoUring,    // 内核不支持时 Reactor 退回 epoll
+};
+
+struct PollEvent
+{
+    uint64_t data;
+    uint32_t events;
+};
+
+class Poller
+{
+public:
+    virtual ~Poller() = default;
+
+    virtual PollerBackend Backend() const = 0;
+
+    virtual bool Add(int fd, uint64_t data, uint32_t interest, bool edge) = 0;
+
+    virtual bool Modify(int fd, uint64_t data, uint32_t interest, bool edge) = 0;
+
+    virtual void Remove(int fd) = 0;
+
+    // 等到有事件或到达 deadline_ns 为止，最多取回 max_events 个；出错（EINTR）或超时返回 0
+    virtual int Wait(PollEvent *out, int max_events, int64_t deadline_ns) = 0;
+
+    static int64_t ClockNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+class EpollPoller : public Poller
+{
+public:
+    explicit EpollPoller(size_t max_events)
+        : events(max_events > 0 ? max_events : 1)
+    {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+    }
+
+    ~EpollPoller() override
+    {
+        close(epfd);
+    }
+
+    PollerBackend Backend() const override
+    {
+        return PollerBackend::Epoll;
+    }
+
+    bool Add(int fd, uint64_t data, uint32_t interest, bool edge) override
+    {
+        epoll_event ev = MakeEvent(data, interest, edge);
+        return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+
+    bool Modify(int fd, uint64_t data, uint32_t interest, bool edge) override
+    {
+        epoll_event ev = MakeEvent(data, interest, edge);
+        return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+    }
+
+    void Remove(int fd) override
+    {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+
+    int Wait(PollEvent *out, int max_events, int64_t deadline_ns) override
+    {
+        if(static_cast<size_t>(max_events) > events.size())
+        {
+            max_events = static_cast<int>(events.size());
+        }
+        int n = epoll_wait(epfd, events.data(), max_events, TimeoutMs(deadline_ns));
+        for(int i = 0; i < n; ++i)
+        {
+            out[i].data = events[i].data.u64;
+            out[i].events = events[i].events;
+        }
+        return n > 0 ? n : 0;
+    }
+
+private:
+    static epoll_event MakeEvent(uint64_t data, uint32_t interest, bool edge)
+    {
+        epoll_event ev = {};
+        ev.events = interest | (edge ? static_cast<uint32_t>(EPOLLET) : 0u);
+        ev.data.u64 = data;
+        return ev;
+    }
+
+    // 不足 1ms 向上取整，避免提前醒来空转
+    static int TimeoutMs(int64_t deadline_ns)
+    {
+        if(deadline_ns < 0)
+        {
+            return -1;
+        }
+        int64_t gap = deadline_ns - ClockNs();
+        if(gap <= 0)
+        {
+            return 0;
+        }
+        int64_t ms = (gap + 999999) / 1000000;
+        return ms > INT_MAX ? INT_MAX : static_cast<int>(ms);
+    }
+
+    int epfd;
+    std::vector<epoll_event> events;
+};
+
+#endif
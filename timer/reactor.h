@@ -0,0 +1,336 @@
+#ifndef __REACTOR_H__
+#define __REACTOR_H__
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "timer.h"
+#include "timer_stats.h"
+#include "poller.h"
+#include "uring_poller.h"
+
+/*
+    事件循环：持有一个 Poller（epoll 或 io_uring）和一个 Timer，每轮
+        等待 IO 事件，最多等到最早的定时任务 -> UpdateNow() -> 分发 IO 事件 -> HandleTimer()
+    1）fd 按 fd 号登记处理函数，可选水平触发 / 边缘触发；边缘触发的处理函数要自己读到 EAGAIN
+    2）一次等待取回的事件数可配置，取满的次数计入统计，说明该调大了
+    3）timerfd 模式下 timerfd 和其他 fd 一样注册进 Poller，等待时不带截止时间
+    4）Stop() / Wakeup() 可以在任意线程调用，通过内部的 eventfd 唤醒
+    5）io_uring 后端把定时器的截止时间作为 IORING_OP_TIMEOUT 和 poll 一起提交，一次 io_uring_enter 同时等 IO 和定时器；
+       内核不支持时自动退回 epoll，Backend() 返回实际使用的后端
+    除了 Stop / Wakeup / Metrics 以外的接口都只能在 loop 线程调用
+*/
+
+enum class TriggerMode : uint8_t
+{
+    Level,      // 水平触发，没处理完下一轮还会通知
+    Edge,       // 边缘触发（EPOLLET），状态变化时只通知一次
+};
+
+struct ReactorOptions
+{
+    TimerBackend backend = TimerBackend::Set;
+    TimerResolution resolution = TimerResolution::Milli;
+    size_t max_events = 256;    // 一次等待最多取回的事件数
+    bool use_timerfd = false;
+    PollerBackend poller = PollerBackend::Epoll;
+};
+
+// 事件循环统计快照，都是累计值
+struct ReactorMetrics
+{
+    uint64_t iterations = 0;    // 等待次数
+    uint64_t events = 0;        // 分发的 IO 事件数
+    uint64_t idle_wakeups = 0;  // 没有任何 IO 事件的唤醒（定时器超时或空唤醒）
+    uint64_t full_batches = 0;  // 事件数等于 max_events 的次数
+    uint64_t max_batch = 0;     // 单次取回的最多事件数
+    uint64_t wait_ns = 0;       // 阻塞在等待里的时间
+    uint64_t busy_ns = 0;       // 处理事件和定时任务的时间
+};
+
+class Reactor
+{
+public:
+    using Handler = SmallFunction<void(uint32_t events)>;
+
+    explicit Reactor(const ReactorOptions &options = ReactorOptions())
+        : timer(options.backend, options.resolution),
+          poller(MakePoller(options)),
+          events(options.max_events > 0 ? options.max_events : 1)
+    {
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        Add(wake_fd, EPOLLIN, [this](uint32_t) {
+            uint64_t value;
+            ssize_t ret = read(wake_fd, &value, sizeof(value));
+            (void)ret;
+        });
+        if(options.use_timerfd)
+        {
+            int tfd = timer.EnableTimerfd();
+            if(tfd >= 0)
+            {
+                Add(tfd, EPOLLIN, [this](uint32_t) { timer.HandleTimerfd(); });
+            }
+        }
+    }
+
+    // 工作线程池（如果有）必须先于 Reactor 析构
+    ~Reactor()
+    {
+        close(wake_fd);
+    }
+
+    Reactor(const Reactor &) = delete;
+    Reactor &operator=(const Reactor &) = delete;
+
+    Timer &GetTimer()
+    {
+        return timer;
+    }
+
+    PollerBackend Backend() const
+    {
+        return poller->Backend();
+    }
+
+    // 登记 fd 的处理函数，events 是 EPOLLIN / EPOLLOUT 等；fd 已经登记过时返回 false
+    bool Add(int fd, uint32_t interest, Handler handler, TriggerMode mode = TriggerMode::Level)
+    {
+        if(fd < 0)
+        {
+            return false;
+        }
+        if(static_cast<size_t>(fd) >= entries.size())
+        {
+            entries.resize(fd + 1);
+        }
+        if(!entries[fd])
+        {
+            entries[fd] = std::make_unique<Entry>();
+        }
+        Entry &entry = *entries[fd];
+        if(entry.active)
+        {
+            return false;
+        }
+        entry.gen = ++next_gen;
+        if(!poller->Add(fd, MakeData(fd, entry.gen), interest, mode == TriggerMode::Edge))
+        {
+            return false;
+        }
+        entry.handler = std::move(handler);    // 没有登记的 entry 的处理函数已经在 Remove 时释放
+        entry.active = true;
+        return true;
+    }
+
+    // 修改关注的事件和触发方式，处理函数不变
+    bool Modify(int fd, uint32_t interest, TriggerMode mode = TriggerMode::Level)
+    {
+        Entry *entry = Find(fd);
+        if(entry == nullptr)
+        {
+            return false;
+        }
+        return poller->Modify(fd, MakeData(fd, entry->gen), interest, mode == TriggerMode::Edge);
+    }
+
+    // 取消登记，可以在任何处理函数（包括 fd 自己的）里调用；本轮已经取回的该 fd 的事件不再分发
+    bool Remove(int fd)
+    {
+        Entry *entry = Find(fd);
+        if(entry == nullptr)
+        {
+            return false;
+        }
+        poller->Remove(fd);
+        entry->active = false;
+        if(fd == current_fd)
+        {
+            // 正在执行的处理函数不能就地析构，整个 Entry 挪到 retired，回调返回后再释放
+            retired = std::move(entries[fd]);
+        }
+        else
+        {
+            entry->handler = nullptr;
+        }
+        return true;
+    }
+
+    // offload 的完成通知 fd 也由 Reactor 处理
+    int EnableOffload(WorkStealingPool *pool)
+    {
+        int ofd = timer.EnableOffload(pool);
+        if(ofd >= 0 && Find(ofd) == nullptr)
+        {
+            Add(ofd, EPOLLIN, [this](uint32_t) { timer.HandleOffloadDone(); });
+        }
+        return ofd;
+    }
+
+    /*
+        跑一轮：等待 IO 事件或最早的定时任务，分发 IO 事件，再执行到期的定时任务
+        timeout_ms >= 0 时最多等这么久，便于外面再套自己的定时逻辑
+    */
+    void RunOnce(int timeout_ms = -1)
+    {
+        int64_t begin = ClockNs();
+        int64_t deadline = timer.TimerFd() >= 0 ? -1 : timer.NextDeadlineNs();
+        if(timeout_ms >= 0 && (deadline < 0 || begin + timeout_ms * 1000000LL < deadline))
+        {
+            deadline = begin + timeout_ms * 1000000LL;
+        }
+
+        int n = poller->Wait(events.data(), static_cast<int>(events.size()), deadline);
+        int64_t woke = ClockNs();
+        timer.UpdateNow();
+
+        for(int i = 0; i < n; ++i)
+        {
+            int fd = static_cast<int>(events[i].data & 0xffffffff);
+            uint32_t gen = static_cast<uint32_t>(events[i].data >> 32);
+            Entry *entry = Find(fd);
+            if(entry == nullptr || entry->gen != gen)
+            {
+                continue;   // 本轮前面的处理函数已经把它删掉（或删掉后又换了一个）
+            }
+            current_fd = fd;
+            entry->handler(events[i].events);
+            current_fd = -1;
+            retired.reset();
+        }
+
+        if(timer.TimerFd() < 0)
+        {
+            timer.HandleTimer();
+        }
+
+        StatsBump(metrics.iterations);
+        StatsBump(metrics.events, static_cast<uint64_t>(n));
+        if(n == 0)
+        {
+            StatsBump(metrics.idle_wakeups);
+        }
+        if(static_cast<size_t>(n) == events.size())
+        {
+            StatsBump(metrics.full_batches);
+        }
+        if(static_cast<uint64_t>(n) > metrics.max_batch.load(std::memory_order_relaxed))
+        {
+            metrics.max_batch.store(static_cast<uint64_t>(n), std::memory_order_relaxed);
+        }
+        StatsBump(metrics.wait_ns, static_cast<uint64_t>(woke - begin));
+        StatsBump(metrics.busy_ns, static_cast<uint64_t>(ClockNs() - woke));
+    }
+
+    // 一直运行，直到 Stop()
+    void Run()
+    {
+        running.store(true, std::memory_order_relaxed);
+        while(running.load(std::memory_order_acquire))
+        {
+            RunOnce();
+        }
+    }
+
+    // 任意线程调用
+    void Stop()
+    {
+        running.store(false, std::memory_order_release);
+        Wakeup();
+    }
+
+    // 任意线程调用：让阻塞中的等待立即返回
+    void Wakeup()
+    {
+        uint64_t one = 1;
+        ssize_t ret = write(wake_fd, &one, sizeof(one));
+        (void)ret;
+    }
+
+    // 任意线程调用
+    ReactorMetrics Metrics() const
+    {
+        ReactorMetrics out;
+        out.iterations = metrics.iterations.load(std::memory_order_relaxed);
+        out.events = metrics.events.load(std::memory_order_relaxed);
+        out.idle_wakeups = metrics.idle_wakeups.load(std::memory_order_relaxed);
+        out.full_batches = metrics.full_batches.load(std::memory_order_relaxed);
+        out.max_batch = metrics.max_batch.load(std::memory_order_relaxed);
+        out.wait_ns = metrics.wait_ns.load(std::memory_order_relaxed);
+        out.busy_ns = metrics.busy_ns.load(std::memory_order_relaxed);
+        return out;
+    }
+
+private:
+    struct Entry
+    {
+        Handler handler;
+        uint32_t gen = 0;       // 每次 Add 分配新的编号，和事件里带的 gen 不一致说明是旧登记的事件
+        bool active = false;
+    };
+
+    // 单写者的计数，Metrics() 可以在别的线程读
+    struct Counters
+    {
+        std::atomic<uint64_t> iterations{0};
+        std::atomic<uint64_t> events{0};
+        std::atomic<uint64_t> idle_wakeups{0};
+        std::atomic<uint64_t> full_batches{0};
+        std::atomic<uint64_t> max_batch{0};
+        std::atomic<uint64_t> wait_ns{0};
+        std::atomic<uint64_t> busy_ns{0};
+    };
+
+    // 事件里带回的 data：gen << 32 | fd
+    static uint64_t MakeData(int fd, uint32_t gen)
+    {
+        return (static_cast<uint64_t>(gen) << 32) | static_cast<uint32_t>(fd);
+    }
+
+    // 要求 io_uring 但内核不支持时退回 epoll
+    static std::unique_ptr<Poller> MakePoller(const ReactorOptions &options)
+    {
+        if(options.poller == PollerBackend::IoUring)
+        {
+            std::unique_ptr<IoUringPoller> uring = std::make_unique<IoUringPoller>(options.max_events);
+            if(uring->Ok())
+            {
+                return uring;
+            }
+        }
+        return std::make_unique<EpollPoller>(options.max_events);
+    }
+
+    Entry *Find(int fd)
+    {
+        if(fd < 0 || static_cast<size_t>(fd) >= entries.size() || !entries[fd] || !entries[fd]->active)
+        {
+            return nullptr;
+        }
+        return entries[fd].get();
+    }
+
+    static int64_t ClockNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    Timer timer;
+    std::unique_ptr<Poller> poller;
+    int wake_fd;
+    std::vector<PollEvent> events;
+    std::vector<std::unique_ptr<Entry>> entries;    // fd -> 登记信息，Entry 地址固定，处理函数里增删 fd 不会移动正在执行的函数
+    int current_fd = -1;        // 正在执行处理函数的 fd
+    std::unique_ptr<Entry> retired;     // 在自己的处理函数里被删掉的登记
+    uint32_t next_gen = 0;
+    std::atomic<bool> running{false};
+    Counters metrics;
+};
+
+#endif
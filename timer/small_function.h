@@ -0,0 +1,211 @@
+#ifndef __SMALL_FUNCTION_H__
+#define __SMALL_FUNCTION_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+    只能移动的小对象回调，代替 std::function：
+    1）捕获对象直接构造在内部缓冲区里（默认 48 字节），不分配内存
+    2）只能移动不能拷贝，插入定时器时不会把捕获的对象复制一遍
+    3）捕获超过缓冲区大小时默认编译报错；
+       定义 SMALL_FUNCTION_ALLOW_HEAP 后改为在堆上分配，并计入 SmallFunctionHeapFallbacks()
+*/
+
+#ifndef SMALL_FUNCTION_INLINE_SIZE
+#define SMALL_FUNCTION_INLINE_SIZE 48
+#endif
+
+// 超出内部缓冲区、退化为堆分配的次数（只有定义了 SMALL_FUNCTION_ALLOW_HEAP 才会增加）
+inline std::atomic<uint64_t> &SmallFunctionHeapFallbacks()
+{
+    static std::atomic<uint64_t> counter{0};
+    return counter;
+}
+
+template <class Sig, size_t InlineSize = SMALL_FUNCTION_INLINE_SIZE>
+class SmallFunction;
+
+template <class R, class... Args, size_t InlineSize>
+class SmallFunction<R(Args...), InlineSize>
+{
+public:
+    static constexpr size_t kInlineSize = InlineSize;
+
+    SmallFunction() noexcept : ops(nullptr) {}
+    SmallFunction(std::nullptr_t) noexcept : ops(nullptr) {}
+
+    template <class F, class D = typename std::decay<F>::type,
+              class = typename std::enable_if<!std::is_same<D, SmallFunction>::value>::type>
+    SmallFunction(F &&f) : ops(nullptr)
+    {
+        Assign<D>(std::forward<F>(f));
+    }
+
+    SmallFunction(SmallFunction &&other) noexcept : ops(nullptr)
+    {
+        MoveFrom(other);
+    }
+
+    SmallFunction &operator = (SmallFunction &&other) noexcept
+    {
+        if(this != &other)
+        {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    SmallFunction &operator = (std::nullptr_t) noexcept
+    {
+        Reset();
+        return *this;
+    }
+
+    template <class F, class D = typename std::decay<F>::type,
+              class = typename std::enable_if<!std::is_same<D, SmallFunction>::value>::type>
+    SmallFunction &operator = (F &&f)
+    {
+        Reset();
+        Assign<D>(std::forward<F>(f));
+        return *this;
+    }
+
+    SmallFunction(const SmallFunction &) = delete;
+    SmallFunction &operator = (const SmallFunction &) = delete;
+
+    ~SmallFunction()
+    {
+        Reset();
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return ops != nullptr;
+    }
+
+    R operator()(Args... args) const
+    {
+        return ops->invoke(const_cast<void *>(static_cast<const void *>(storage)), std::forward<Args>(args)...);
+    }
+
+    // 可调用对象 F 能否放进内部缓冲区
+    template <class F>
+    static constexpr bool FitsInline()
+    {
+        return sizeof(F) <= InlineSize
+            && alignof(F) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<F>::value;
+    }
+
+private:
+    struct Ops
+    {
+        R (*invoke)(void *storage, Args &&...args);
+        void (*move)(void *dst, void *src) noexcept;   // 移动构造到 dst 并析构 src
+        void (*destroy)(void *storage) noexcept;
+    };
+
+    template <class F>
+    struct InlineOps
+    {
+        static R Invoke(void *storage, Args &&...args)
+        {
+            return (*static_cast<F *>(storage))(std::forward<Args>(args)...);
+        }
+        static void Move(void *dst, void *src) noexcept
+        {
+            F *from = static_cast<F *>(src);
+            ::new (dst) F(std::move(*from));
+            from->~F();
+        }
+        static void Destroy(void *storage) noexcept
+        {
+            static_cast<F *>(storage)->~F();
+        }
+        static constexpr Ops ops = {&Invoke, &Move, &Destroy};
+    };
+
+    template <class F>
+    struct HeapOps
+    {
+        static F *&Ptr(void *storage)
+        {
+            return *static_cast<F **>(storage);
+        }
+        static R Invoke(void *storage, Args &&...args)
+        {
+            return (*Ptr(storage))(std::forward<Args>(args)...);
+        }
+        static void Move(void *dst, void *src) noexcept
+        {
+            ::new (dst) F *(Ptr(src));
+        }
+        static void Destroy(void *storage) noexcept
+        {
+            delete Ptr(storage);
+        }
+        static constexpr Ops ops = {&Invoke, &Move, &Destroy};
+    };
+
+    template <class D, class F>
+    void Assign(F &&f)
+    {
+        if constexpr(std::is_pointer<D>::value || std::is_member_pointer<D>::value)
+        {
+            if(f == nullptr)
+            {
+                return;
+            }
+        }
+
+        if constexpr(FitsInline<D>())
+        {
+            ::new (static_cast<void *>(storage)) D(std::forward<F>(f));
+            ops = &InlineOps<D>::ops;
+        }
+        else
+        {
+#ifdef SMALL_FUNCTION_ALLOW_HEAP
+            ::new (static_cast<void *>(storage)) D *(new D(std::forward<F>(f)));
+            ops = &HeapOps<D>::ops;
+            SmallFunctionHeapFallbacks().fetch_add(1, std::memory_order_relaxed);
+#else
+            static_assert(FitsInline<D>(),
+                "SmallFunction: callable does not fit the inline buffer; capture less, "
+                "raise SMALL_FUNCTION_INLINE_SIZE or define SMALL_FUNCTION_ALLOW_HEAP");
+#endif
+        }
+    }
+
+    void MoveFrom(SmallFunction &other) noexcept
+    {
+        if(other.ops != nullptr)
+        {
+            other.ops->move(storage, other.storage);
+            ops = other.ops;
+            other.ops = nullptr;
+        }
+    }
+
+    void Reset() noexcept
+    {
+        if(ops != nullptr)
+        {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
+    static_assert(InlineSize >= sizeof(void *), "SmallFunction: inline buffer must hold at least a pointer");
+
+    alignas(std::max_align_t) unsigned char storage[InlineSize];
+    const Ops *ops;
+};
+
+#endif
@@ -1,145 +1,134 @@
-#include <sys/epoll.h>
-#include <functional>
-#include <chrono>
-#include <set>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include <memory>
 #include <iostream>
+#include <cstring>
+#include <thread>
 
-using namespace std;
-
-/* 用 set 作为容器，epoll 作为触发机制的简易定时器 */
-
-struct TimerNodeBase
-{
-    time_t expire;  // 触发事件, Now + 定时时间
-    uint64_t id;    // 由于时间可能重复，所以用 id 唯一表示定时任务q  
-};
-
-struct TimerNode : public TimerNodeBase
-{
-    using Cb = std::function<void(const TimerNode &node)>;
+#include "reactor.h"
 
-    Cb func;
-    TimerNode(uint64_t id, time_t expire, Cb func) 
-        : func(func)
-        {
-            this->expire = expire;
-            this->id = id;
-        }
-};
-
-bool operator < (const TimerNodeBase &LTimer, const TimerNodeBase &RTimer)
-{
-    if(LTimer.expire < RTimer.expire)
-        return true;
-    else if(LTimer.expire > RTimer.expire)
-        return false;
-    else
-        return LTimer.id < RTimer.id;       // 如果触发时间相等，则id的大放在后面触发
-}
+using namespace std;
 
-class Timer
+int main(int argc, char *argv[])
 {
-public:
-    // 返回从 steady_clock（通常是程序启动时间）到当前时间的毫秒数  
-    static time_t GetTick()
+    // ./timer [wheel|heap] [timerfd] [us|ns] [budget] [offload] [uring]：wheel 使用时间轮引擎，heap 使用 4 叉堆（默认 set），timerfd 使用 timerfd 驱动，
+    // us/ns 指定 tick 精度，budget 限制每轮 loop 最多执行 2 个回调，offload 把 3000ms 的任务放到线程池执行，uring 使用 io_uring（不支持时退回 epoll）
+    ReactorOptions options;
+    bool budget = false;
+    bool offload = false;
+    for(int arg = 1; arg < argc; ++arg)
     {
-        auto sc = chrono::time_point_cast<chrono::microseconds>(chrono::steady_clock::now());
-        auto tmp = chrono::duration_cast<chrono::milliseconds>(sc.time_since_epoch());
-        return tmp.count();
+        if(strcmp(argv[arg], "wheel") == 0)
+            options.backend = TimerBackend::Wheel;
+        else if(strcmp(argv[arg], "heap") == 0)
+            options.backend = TimerBackend::Heap;
+        else if(strcmp(argv[arg], "timerfd") == 0)
+            options.use_timerfd = true;
+        else if(strcmp(argv[arg], "us") == 0)
+            options.resolution = TimerResolution::Micro;
+        else if(strcmp(argv[arg], "ns") == 0)
+            options.resolution = TimerResolution::Nano;
+        else if(strcmp(argv[arg], "budget") == 0)
+            budget = true;
+        else if(strcmp(argv[arg], "offload") == 0)
+            offload = true;
+        else if(strcmp(argv[arg], "uring") == 0)
+            options.poller = PollerBackend::IoUring;
     }
-
-    // 给定时器添加定时任务
-    TimerNodeBase AddTimer(time_t msec, TimerNode::Cb func)
-    {
-        time_t expire = GetTick() + msec;
-        // 如果这个新添加的任务不是最晚触发的，则正常插入
-        if(timeouts.empty() || expire <= timeouts.crbegin()->expire)
-        {
-            auto pairs = timeouts.emplace(GenID(), expire, std::move(func));
-            return static_cast<TimerNodeBase>(*pairs.first);
-        }
-        // 如果新任务的触发时间 expire 比当前所有任务都晚，则 使用 emplace_hint() 进行优化插入
-        auto ele = timeouts.emplace_hint(timeouts.crbegin().base(), GenID(), expire, std::move(func));
-        return static_cast<TimerNodeBase>(*ele);
-    }
-
-    bool DelTimer(TimerNodeBase &node)
+    Reactor reactor(options);
+    Timer &timer = reactor.GetTimer();
+    cout << "poller:" << (reactor.Backend() == PollerBackend::IoUring ? "io_uring" : "epoll") << endl;
+    if(budget)
     {
-        auto iter = timeouts.find(node);
-        if(iter != timeouts.end())
-        {
-            timeouts.erase(iter);
-            return true;
-        }
-        return false;
+        timer.SetDispatchBudget(2);
     }
 
-    void HandleTimer(time_t now)
+    // 线程池要比 reactor 晚构造、早析构
+    unique_ptr<WorkStealingPool> workers;
+    if(offload)
     {
-        auto iter = timeouts.begin();
-        while(iter != timeouts.end() && iter->expire <= now)
-        {
-            iter->func(*iter);
-            iter = timeouts.erase(iter);
-        }
+        workers = make_unique<WorkStealingPool>(2);
+        reactor.EnableOffload(workers.get());
     }
 
-    time_t TimeToSleep()
-    {
-        if(0 == timeouts.size())
+    // 边缘触发的 eventfd：心跳写入，处理函数读到 EAGAIN 为止
+    int notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    reactor.Add(notify_fd, EPOLLIN, [&](uint32_t) {
+        uint64_t value;
+        while(read(notify_fd, &value, sizeof(value)) == sizeof(value))
         {
-            return -1;
+            cout << Timer::GetTick() << " notify fd readable, value:" << value << endl;
         }
-        time_t time_gap = timeouts.begin()->expire - GetTick();
-        return time_gap > 0 ? time_gap : 0; 
-    }
-
-private:
-    // 返回唯一的任务id
-    static uint64_t GenID()
-    {
-        return gid++;
-    }
-    static uint64_t gid;
-    set<TimerNode, std::less<>> timeouts;
-};
-
-uint64_t Timer::gid = 0;
-
-int main()
-{
-    int epfd = epoll_create(1);
-
-    unique_ptr<Timer> timer = make_unique<Timer>();
+    }, TriggerMode::Edge);
 
     int i = 0;
-    timer->AddTimer(1000, [&](const TimerNode &node) {
+    timer.AddTimer(1000, [&](const TimerNode &node) {
         cout << Timer::GetTick() << " node id:" << node.id << " revoked times:" << ++i << endl;
     });
 
-    timer->AddTimer(1000, [&](const TimerNode &node) {
+    timer.AddTimer(1000, [&](const TimerNode &node) {
         cout << Timer::GetTick() << " node id:" << node.id << " revoked times:" << ++i << endl;
     });
 
-    timer->AddTimer(3000, [&](const TimerNode &node) {
-        cout << Timer::GetTick() << " node id:" << node.id << " revoked times:" << ++i << endl;
+    // offload 时在工作线程执行，不碰 loop 线程的变量
+    auto heavy = timer.AddTimer(3000, [](const TimerNode &node) {
+        cout << Timer::GetTick() << " node id:" << node.id << " heavy task on thread:" << this_thread::get_id() << endl;
     });
+    timer.SetOffload(heavy);
 
-    auto node = timer->AddTimer(2100, [&](const TimerNode &node) {
+    auto handle = timer.AddTimer(2100, [&](const TimerNode &node) {
         cout << Timer::GetTick() << " node id:" << node.id << " revoked times:" << ++i << endl;
     });
 
-    timer->DelTimer(node);
+    timer.DelTimer(handle);
 
-    cout << "now time:" << Timer::GetTick() << endl;
-    epoll_event ev[64] = {0};
+    // 空闲超时：每次心跳都续期 1000ms，最后一次心跳之后 1000ms 才触发
+    auto idle = timer.AddTimer(1000, [&](const TimerNode &node) {
+        cout << Timer::GetTick() << " idle timeout, expire:" << node.expire << endl;
+    });
 
-    while(1)
+    // 周期任务：每 500ms 一次，执行 4 次后在回调里取消自己
+    int beats = 0;
+    TimerHandle heartbeat;
+    heartbeat = timer.AddPeriodicTimer(500, 500, [&](const TimerNode &node) {
+        cout << Timer::GetTick() << " heartbeat expire:" << node.expire << " times:" << ++beats << endl;
+        timer.ExtendTimer(idle, 1000);
+        uint64_t one = 1;
+        ssize_t ret = write(notify_fd, &one, sizeof(one));
+        (void)ret;
+        if(beats == 4)
+        {
+            timer.DelTimer(heartbeat);
+        }
+    });
+
+    // 允许推迟 64ms 的超时任务：要求的时间各不相同，对齐后合并成一两次触发
+    for(int k = 0; k < 5; ++k)
     {
-        int n = epoll_wait(epfd, ev, 64, timer->TimeToSleep());
-        time_t now = Timer::GetTick();
-        timer->HandleTimer(now);
+        timer.AddTimer(1200 + 7 * k, [&, k](const TimerNode &node) {
+            cout << Timer::GetTick() << " slack task " << k << " due:" << node.due << " expire:" << node.expire << endl;
+        }, 64);
     }
+
+    // 亚毫秒任务：在 us / ns 精度下按 tick 精确触发
+    timer.AddTimer(chrono::microseconds(1500), [&](const TimerNode &node) {
+        cout << Timer::GetTick() << " 1.5ms task, expire tick:" << node.expire << endl;
+    });
+
+    // 所有任务都跑完后退出 loop
+    timer.AddTimer(3500, [&](const TimerNode &) {
+        reactor.Stop();
+    });
+
+    cout << "now time:" << Timer::GetTick() << endl;
+    reactor.Run();
+
+    ReactorMetrics metrics = reactor.Metrics();
+    cout << "loop iterations:" << metrics.iterations << " events:" << metrics.events
+         << " idle wakeups:" << metrics.idle_wakeups << " max batch:" << metrics.max_batch
+         << " wait:" << metrics.wait_ns / 1000000 << "ms busy:" << metrics.busy_ns / 1000 << "us" << endl;
+
+    reactor.Remove(notify_fd);
+    close(notify_fd);
     return 0;
-}
\ No newline at end of file
+}
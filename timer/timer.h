@@ -0,0 +1,1157 @@
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <chrono>
+#include <set>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "timer_engine.h"
+#include "timing_wheel.h"
+#include "timer_heap.h"
+#include "timer_pool.h"
+#include "timer_stats.h"
+#include "worker_pool.h"
+#include "timer_snapshot.h"
+
+/* 定时器：任务节点 + 可替换的存储引擎（set / 时间轮 / 4 叉堆），epoll（或 timerfd）作为触发机制 */
+
+/*
+    用 set 作为容器的引擎，插入 O(log n)；按节点下标保存迭代器，删除不需要查找
+    红黑树节点从引擎自带的定长块链表里分配，稳态下不再走 malloc
+*/
+class SetTimerEngine : public TimerEngine
+{
+public:
+    SetTimerEngine()
+        : timeouts(NodeLess(), ArenaAllocator<TimerNode *>(&arena))
+        {}
+
+    void Insert(TimerNode *node) override
+    {
+        if(node->slot >= where.size())
+        {
+            where.resize(node->slot + 1);
+        }
+        // 如果这个新添加的任务不是最晚触发的，则正常插入
+        if(timeouts.empty() || *node < **timeouts.crbegin())
+        {
+            where[node->slot] = timeouts.insert(node).first;
+            return;
+        }
+        // 如果新任务的触发时间 expire 比当前所有任务都晚，则 使用 emplace_hint() 进行优化插入
+        where[node->slot] = timeouts.emplace_hint(timeouts.end(), node);
+    }
+
+    void Erase(TimerNode *node) override
+    {
+        timeouts.erase(where[node->slot]);
+    }
+
+    // set 按节点的 expire 排序，必须先摘下再改；摘下的树节点原样插回，不重新分配
+    void Update(TimerNode *node, time_t expire) override
+    {
+        auto handle = timeouts.extract(where[node->slot]);
+        node->expire = expire;
+        where[node->slot] = timeouts.insert(std::move(handle)).position;
+    }
+
+    // 引擎为空时按顺序用尾部 hint 建树，输入已经有序（快照按触发时间保存）时是 O(n)
+    void BulkLoad(std::vector<TimerNode *> &nodes) override
+    {
+        if(!timeouts.empty())
+        {
+            TimerEngine::BulkLoad(nodes);
+            return;
+        }
+        if(!std::is_sorted(nodes.begin(), nodes.end(), NodeLess()))
+        {
+            std::sort(nodes.begin(), nodes.end(), NodeLess());
+        }
+        for(TimerNode *node : nodes)
+        {
+            if(node->slot >= where.size())
+            {
+                where.resize(node->slot + 1);
+            }
+            where[node->slot] = timeouts.emplace_hint(timeouts.end(), node);
+        }
+    }
+
+    /*
+        到期的一定是 set 的前缀：全部到期直接 clear()；到期的超过一半时，
+        把剩下的有序部分用尾部 hint 重新建树（O(n)），避免逐个删除时反复旋转平衡
+    */
+    void CollectExpired(time_t now, std::vector<TimerNode *> &out) override
+    {
+        auto last = timeouts.begin();
+        size_t expired = 0;
+        while(last != timeouts.end() && (*last)->expire <= now)
+        {
+            out.push_back(*last);
+            ++last;
+            ++expired;
+        }
+        if(expired == 0)
+        {
+            return;
+        }
+        if(last == timeouts.end())
+        {
+            timeouts.clear();
+            return;
+        }
+        if(expired * 2 < timeouts.size())
+        {
+            timeouts.erase(timeouts.begin(), last);
+            return;
+        }
+
+        rest.assign(last, timeouts.end());
+        timeouts.clear();
+        for(TimerNode *node : rest)
+        {
+            where[node->slot] = timeouts.emplace_hint(timeouts.end(), node);
+        }
+        rest.clear();
+    }
+
+    time_t NearestExpire() const override
+    {
+        return timeouts.empty() ? -1 : (*timeouts.begin())->expire;
+    }
+
+    size_t Size() const override
+    {
+        return timeouts.size();
+    }
+
+private:
+    // expire、id 都相同（id 回绕、实例号回绕）时再比较 slot：活着的节点 slot 各不相同，插入不会因为“重复”失败
+    struct NodeLess
+    {
+        bool operator()(const TimerNode *l, const TimerNode *r) const
+        {
+            if(*l < *r)
+                return true;
+            if(*r < *l)
+                return false;
+            return l->slot < r->slot;
+        }
+    };
+    using Set = std::set<TimerNode *, NodeLess, ArenaAllocator<TimerNode *>>;
+
+    FixedBlockArena arena;      // 必须先于 timeouts 构造、晚于 timeouts 析构
+    Set timeouts;
+    std::vector<Set::iterator> where;   // 节点下标 -> 在 set 中的位置
+    std::vector<TimerNode *> rest;      // 重建时暂存未到期的节点，复用内存
+};
+
+enum class TimerBackend
+{
+    Set,        // std::set，红黑树
+    Wheel,      // 分层时间轮
+    Heap,       // 4 叉小根堆
+};
+
+// 定时器内部时间（tick）的精度，expire / HandleTimer(now) 都以 tick 为单位
+enum class TimerResolution
+{
+    Milli,
+    Micro,
+    Nano,
+};
+
+class Timer
+{
+public:
+    // 构造时选择存储引擎和 tick 精度，便于对比不同实现
+    explicit Timer(TimerBackend backend = TimerBackend::Set,
+                   TimerResolution resolution = TimerResolution::Milli)
+        : resolution(resolution)
+    {
+        ns_per_tick = resolution == TimerResolution::Milli ? 1000000
+                    : resolution == TimerResolution::Micro ? 1000 : 1;
+        now_tick = ReadClock();
+        // 纳秒精度下时间轮一格取 1024ns，否则最高层只能覆盖几秒
+        if(backend == TimerBackend::Wheel)
+            engine = std::make_unique<TimingWheelEngine>(now_tick, resolution == TimerResolution::Nano ? 10 : 0);
+        else if(backend == TimerBackend::Heap)
+            engine = std::make_unique<HeapTimerEngine>();
+        else
+            engine = std::make_unique<SetTimerEngine>();
+    }
+
+    // 开启了 offload 时，线程池必须先于 Timer 析构（或者保证已经没有在执行中的回调）
+    ~Timer()
+    {
+        if(timer_fd >= 0)
+        {
+            close(timer_fd);
+        }
+        if(offload_fd >= 0)
+        {
+            close(offload_fd);
+        }
+    }
+
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+
+    /*
+        timerfd 模式：Timer 持有一个 CLOCK_MONOTONIC 的 timerfd，按最早的 expire 设置绝对时间，
+        只有最早的触发时间变化时才重新设置。把返回的 fd 注册到 epoll，epoll_wait 可以无限等待，
+        fd 可读时调用 HandleTimerfd()。失败返回 -1
+    */
+    int EnableTimerfd()
+    {
+        if(timer_fd >= 0)
+        {
+            return timer_fd;
+        }
+        timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(timer_fd >= 0)
+        {
+            armed_expire = -1;
+            SyncTimerfd();
+        }
+        return timer_fd;
+    }
+
+    int TimerFd() const
+    {
+        return timer_fd;
+    }
+
+    // timerfd 可读时调用：清掉到期计数，执行到期任务并重新设置 timerfd
+    void HandleTimerfd()
+    {
+        uint64_t expirations;
+        while(read(timer_fd, &expirations, sizeof(expirations)) > 0)
+        {
+        }
+        armed_expire = -1;
+        HandleTimer(UpdateNow());
+    }
+
+    /*
+        offload 模式：SetOffload() 标记过的任务到期后，回调交给线程池 pool 执行，
+        节点的回收 / 周期任务的下一次调度仍然在 loop 线程完成。回调执行完后返回的 eventfd 可读，
+        把它注册到 epoll，可读时调用 HandleOffloadDone()。失败返回 -1
+    */
+    int EnableOffload(WorkStealingPool *pool)
+    {
+        if(offload_fd < 0)
+        {
+            offload_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        }
+        worker_pool = offload_fd >= 0 ? pool : nullptr;
+        return offload_fd;
+    }
+
+    int OffloadFd() const
+    {
+        return offload_fd;
+    }
+
+    /*
+        把任务标记为在线程池执行（没有调用 EnableOffload 时仍在 loop 线程执行）
+        回调在工作线程里只能读 node，不能调用本 Timer 的任何接口；周期任务等上一次执行完才会调度下一次
+    */
+    bool SetOffload(TimerHandle handle, bool offload = true)
+    {
+        TimerNode *node = Lookup(handle);
+        if(node == nullptr || node->state == TimerState::Free)
+        {
+            return false;
+        }
+        if(node->state == TimerState::Offloaded)
+        {
+            // 回调可能正在工作线程里读节点，先记下来，收到完成通知后再改
+            offload_ops[node->slot] = (offload_ops[node->slot] & ~(kOffloadOn | kOffloadOff)) | (offload ? kOffloadOn : kOffloadOff);
+            return true;
+        }
+        node->offload = offload;
+        return true;
+    }
+
+    // offload_fd 可读时调用：回收已经执行完的任务，周期任务重新调度
+    void HandleOffloadDone()
+    {
+        uint64_t value;
+        ssize_t ret = read(offload_fd, &value, sizeof(value));
+        (void)ret;
+        {
+            std::lock_guard<std::mutex> lock(offload_mutex);
+            offload_done.swap(offload_batch);
+        }
+        time_t now = UpdateNow();
+        for(TimerNode *node : offload_batch)
+        {
+            --offloaded;
+            // 回调已经执行完，执行期间记下的取消 / SetOffload 这时才写到节点上
+            uint8_t ops = offload_ops[node->slot];
+            offload_ops[node->slot] = 0;
+            if(ops & (kOffloadOn | kOffloadOff))
+            {
+                node->offload = (ops & kOffloadOn) != 0;
+            }
+            if(node->period > 0 && node->state == TimerState::Offloaded && !(ops & kOffloadCancel))
+            {
+                Reschedule(node, now);
+            }
+            else
+            {
+                Release(node);
+            }
+        }
+        offload_batch.clear();
+        PublishPending();
+        if(timer_fd >= 0)
+        {
+            SyncTimerfd();
+        }
+    }
+
+    // 已经交给线程池、还没有收到完成通知的任务数
+    size_t Offloaded() const
+    {
+        return offloaded;
+    }
+
+    // 返回从 steady_clock（通常是程序启动时间）到当前时间的毫秒数
+    static time_t GetTick()
+    {
+        auto sc = std::chrono::time_point_cast<std::chrono::microseconds>(std::chrono::steady_clock::now());
+        auto tmp = std::chrono::duration_cast<std::chrono::milliseconds>(sc.time_since_epoch());
+        return tmp.count();
+    }
+
+    // 按本定时器的精度读取 steady_clock，单位 tick
+    time_t ReadClock() const
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch());
+        return static_cast<time_t>(ns.count() / ns_per_tick);
+    }
+
+    /*
+        缓存的当前时间（tick）：loop 在 epoll_wait 返回后调用一次 UpdateNow()，
+        同一轮里的 AddTimer / 回调里的 AddTimer 都用这个时间，不再逐个读时钟
+    */
+    time_t UpdateNow()
+    {
+        now_tick = ReadClock();
+        return now_tick;
+    }
+
+    time_t Now() const
+    {
+        return now_tick;
+    }
+
+    TimerResolution Resolution() const
+    {
+        return resolution;
+    }
+
+    /*
+        给定时器添加定时任务（毫秒），返回的句柄用于 DelTimer
+        slack_msec：允许推迟触发的时间。空闲超时、保活这类不要求精确的任务给一个 slack，
+        触发时间会对齐到 slack 以内的 2 的幂网格上，相近的任务合并到同一时刻、一次唤醒全部处理；
+        slack 为 0 的任务仍然精确触发
+    */
+    TimerHandle AddTimer(time_t msec, TimerNode::Cb func, time_t slack_msec = 0)
+    {
+        return Schedule(msec * TicksPerMs(), 0, std::move(func), TimerMissPolicy::Skip, slack_msec * TicksPerMs());
+    }
+
+    // 任意精度的延时，例如 AddTimer(std::chrono::microseconds(200), ...)；向上取整到 tick，不会提前触发
+    template <class Rep, class Period>
+    TimerHandle AddTimer(std::chrono::duration<Rep, Period> delay, TimerNode::Cb func,
+                         std::chrono::nanoseconds slack = std::chrono::nanoseconds(0))
+    {
+        return Schedule(ToTicks(delay), 0, std::move(func), TimerMissPolicy::Skip, SlackTicks(slack));
+    }
+
+    /*
+        添加周期任务：首次在 first_msec 后触发，之后每 period 毫秒触发一次
+        重新调度基于上一次的 expire 而不是触发时的时间，不会累积误差；节点和句柄在整个生命周期内复用
+    */
+    TimerHandle AddPeriodicTimer(time_t first_msec, time_t period, TimerNode::Cb func,
+                                 TimerMissPolicy policy = TimerMissPolicy::Skip, time_t slack_msec = 0)
+    {
+        return Schedule(first_msec * TicksPerMs(), std::max<time_t>(period * TicksPerMs(), 1), std::move(func), policy,
+                        slack_msec * TicksPerMs());
+    }
+
+    template <class Rep1, class Period1, class Rep2, class Period2>
+    TimerHandle AddPeriodicTimer(std::chrono::duration<Rep1, Period1> first, std::chrono::duration<Rep2, Period2> period,
+                                 TimerNode::Cb func, TimerMissPolicy policy = TimerMissPolicy::Skip,
+                                 std::chrono::nanoseconds slack = std::chrono::nanoseconds(0))
+    {
+        return Schedule(ToTicks(first), std::max<time_t>(ToTicks(period), 1), std::move(func), policy, SlackTicks(slack));
+    }
+
+    // 按 steady_clock 的绝对时间添加任务，period 非 0 时为周期任务；用于跨线程投递等提前算好触发时间的场景
+    TimerHandle AddTimerAt(std::chrono::steady_clock::time_point deadline, TimerNode::Cb func,
+                           std::chrono::nanoseconds period = std::chrono::nanoseconds(0),
+                           TimerMissPolicy policy = TimerMissPolicy::Skip,
+                           std::chrono::nanoseconds slack = std::chrono::nanoseconds(0))
+    {
+        time_t ticks = period.count() > 0 ? std::max<time_t>(ToTicks(period), 1) : 0;
+        return ScheduleAt(ToTicks(deadline.time_since_epoch()), ticks, std::move(func), policy, SlackTicks(slack));
+    }
+
+    /*
+        持久化任务：回调是 registry 里为 type 登记的处理函数，执行时收到 payload；
+        SaveSnapshot 只保存这类任务，重启后用同样登记过的 registry 调用 LoadSnapshot 恢复
+        registry 必须比 Timer 活得长
+    */
+    void SetTypeRegistry(const TimerTypeRegistry *registry)
+    {
+        type_registry = registry;
+    }
+
+    // 其余参数同 AddPeriodicTimer，period_msec 为 0 是一次性任务；type 没有登记时返回无效句柄
+    TimerHandle AddPersistentTimer(time_t msec, uint32_t type, std::string payload, time_t period_msec = 0,
+                                   TimerMissPolicy policy = TimerMissPolicy::Skip, time_t slack_msec = 0)
+    {
+        const TimerTypeRegistry::Handler *handler = type_registry != nullptr ? type_registry->Find(type) : nullptr;
+        if(handler == nullptr)
+        {
+            return TimerHandle();
+        }
+        time_t period = period_msec > 0 ? std::max<time_t>(period_msec * TicksPerMs(), 1) : 0;
+        TimerHandle handle = Schedule(msec * TicksPerMs(), period, TimerNode::Cb(), policy, slack_msec * TicksPerMs());
+        Persist(Lookup(handle), type, handler, std::move(payload));
+        return handle;
+    }
+
+    /*
+        把持久化任务的快照追加到 out，返回保存的任务数，格式见 timer_snapshot.h；只能在 loop 线程调用
+        等待中、已摘下还没执行的任务保存 due；正在执行或在线程池里的周期任务保存下一次的 due
+    */
+    size_t SaveSnapshot(std::string &out) const
+    {
+        // 按下标顺序扫一遍节点，把要写的字段拷出来；排序和写出只访问这个紧凑数组，不再按时间顺序跳着读节点
+        struct Item
+        {
+            time_t due;
+            uint64_t id;
+            time_t period;
+            time_t slack;
+            uint32_t type;
+            uint8_t flags;
+            const std::string *payload;
+        };
+        std::vector<Item> items;
+        items.reserve(pool.Stats().in_use);
+        for(uint32_t slot = 0; slot < pool.Stats().capacity; ++slot)
+        {
+            const TimerNode *node = pool.Get(slot);
+            if(node->type_tag == 0)
+            {
+                continue;
+            }
+            time_t due;
+            if(node->state == TimerState::Pending || node->state == TimerState::Expired)
+            {
+                due = node->due;
+            }
+            else if(node->period > 0 && node->state == TimerState::Firing)
+            {
+                due = node->due + node->period;
+            }
+            else if(node->period > 0 && node->state == TimerState::Offloaded && !(offload_ops[slot] & kOffloadCancel))
+            {
+                due = node->due + node->period;
+            }
+            else
+            {
+                continue;
+            }
+            bool offload = node->offload;
+            if(node->state == TimerState::Offloaded && (offload_ops[slot] & (kOffloadOn | kOffloadOff)))
+            {
+                offload = (offload_ops[slot] & kOffloadOn) != 0;
+            }
+            uint8_t flags = (node->miss_policy == TimerMissPolicy::CatchUp ? kSnapshotCatchUp : 0)
+                          | (offload ? kSnapshotOffload : 0);
+            items.push_back(Item{due, node->id, node->period, node->slack, node->type_tag, flags, &payloads[slot]});
+        }
+        // 按触发时间排序：时间差编码更短，恢复时 set 引擎可以直接顺序建树
+        std::sort(items.begin(), items.end(), [](const Item &l, const Item &r) {
+            return l.due < r.due || (l.due == r.due && l.id < r.id);
+        });
+
+        int64_t wall_now = WallClockNs();
+        time_t now = ReadClock();
+        SnapshotWriter writer(out);
+        writer.Bytes(kTimerSnapshotMagic, sizeof(kTimerSnapshotMagic));
+        writer.Byte(kTimerSnapshotVersion);
+        writer.Varint(items.size());
+        writer.Varint(static_cast<uint64_t>(wall_now));
+        int64_t prev = wall_now;
+        for(size_t i = 0; i < items.size(); ++i)
+        {
+            // 排序后 payload 的访问是随机的，提前几项预取
+            if(i + 8 < items.size())
+            {
+                __builtin_prefetch(items[i + 8].payload);
+            }
+            const Item &item = items[i];
+            int64_t wall = wall_now + static_cast<int64_t>(item.due - now) * ns_per_tick;
+            writer.Signed(wall - prev);
+            writer.Varint(item.id);
+            writer.Varint(item.type);
+            writer.Varint(static_cast<uint64_t>(item.period * ns_per_tick));
+            writer.Varint(static_cast<uint64_t>(item.slack * ns_per_tick));
+            writer.Byte(item.flags);
+            writer.Varint(item.payload->size());
+            writer.Bytes(item.payload->data(), item.payload->size());
+            prev = wall;
+        }
+        return items.size();
+    }
+
+    /*
+        恢复快照里的任务，type 没有登记的任务跳过；格式错误时一个都不恢复，返回 false
+        先整体解析校验，再一次性申请节点、由引擎批量建结构（BulkLoad），不逐个 Insert；restored 返回恢复的任务数
+        恢复的任务按快照顺序重新生成 id，可以恢复到保存它的同一个实例；停机期间已经过期的任务恢复后立即触发
+    */
+    bool LoadSnapshot(const char *data, size_t size, size_t *restored = nullptr)
+    {
+        struct Entry
+        {
+            int64_t wall;
+            uint64_t type;
+            uint64_t period_ns;
+            uint64_t slack_ns;
+            uint8_t flags;
+            const char *payload;
+            size_t payload_size;
+        };
+
+        SnapshotReader reader(data, size);
+        const char *magic = reader.Bytes(sizeof(kTimerSnapshotMagic));
+        if(magic == nullptr || memcmp(magic, kTimerSnapshotMagic, sizeof(kTimerSnapshotMagic)) != 0
+           || reader.Byte() != kTimerSnapshotVersion)
+        {
+            return false;
+        }
+        uint64_t count = reader.Varint();
+        int64_t wall = static_cast<int64_t>(reader.Varint());
+        if(!reader.Ok() || count > size)    // 每个任务至少占 7 个字节，防止损坏的 count 撑爆内存
+        {
+            return false;
+        }
+        std::vector<Entry> entries;
+        entries.reserve(count);
+        for(uint64_t i = 0; i < count; ++i)
+        {
+            Entry entry;
+            wall += reader.Signed();
+            entry.wall = wall;
+            reader.Varint();        // 保存时的 id，恢复时不用
+            entry.type = reader.Varint();
+            entry.period_ns = reader.Varint();
+            entry.slack_ns = reader.Varint();
+            entry.flags = reader.Byte();
+            entry.payload_size = reader.Varint();
+            entry.payload = reader.Bytes(entry.payload_size);
+            if(!reader.Ok())
+            {
+                return false;
+            }
+            entries.push_back(entry);
+        }
+        if(!reader.AtEnd())
+        {
+            return false;
+        }
+
+        int64_t wall_now = WallClockNs();
+        time_t now = UpdateNow();
+        std::vector<TimerNode *> nodes;
+        nodes.reserve(entries.size());
+        pool.Reserve(pool.Stats().in_use + entries.size());
+        if(payloads.size() < pool.Stats().capacity)
+        {
+            payloads.resize(pool.Stats().capacity);
+        }
+        // 快照里同类型的任务通常很多，连续相同的 type 只查一次
+        uint64_t last_type = 0;
+        const TimerTypeRegistry::Handler *handler = nullptr;
+        for(const Entry &entry : entries)
+        {
+            if(entry.type != last_type)
+            {
+                last_type = entry.type;
+                handler = type_registry != nullptr && entry.type <= UINT32_MAX
+                        ? type_registry->Find(static_cast<uint32_t>(entry.type)) : nullptr;
+            }
+            if(handler == nullptr)
+            {
+                continue;
+            }
+            int64_t left = entry.wall - wall_now;
+            TimerNode *node = pool.Acquire();
+            node->due = now + (left > 0 ? static_cast<time_t>((left + ns_per_tick - 1) / ns_per_tick) : 0);
+            node->slack = static_cast<time_t>(entry.slack_ns / ns_per_tick);
+            node->expire = Coalesce(node->due, node->slack);
+            node->id = GenID();     // 快照里的 id 可能和本实例正在等待的任务相同，排序只依赖触发时间，恢复时重新生成
+            node->period = entry.period_ns > 0
+                         ? std::max<time_t>(static_cast<time_t>((entry.period_ns + ns_per_tick - 1) / ns_per_tick), 1) : 0;
+            node->miss_policy = (entry.flags & kSnapshotCatchUp) ? TimerMissPolicy::CatchUp : TimerMissPolicy::Skip;
+            node->offload = (entry.flags & kSnapshotOffload) != 0;
+            node->state = TimerState::Pending;
+            Persist(node, static_cast<uint32_t>(entry.type), handler, std::string(entry.payload, entry.payload_size));
+            nodes.push_back(node);
+        }
+        engine->BulkLoad(nodes);
+        StatsBump(stats.adds, nodes.size());
+        PublishPending();
+        if(timer_fd >= 0)
+        {
+            SyncTimerfd();
+        }
+        if(restored != nullptr)
+        {
+            *restored = nodes.size();
+        }
+        return true;
+    }
+
+    bool LoadSnapshot(const std::string &data, size_t *restored = nullptr)
+    {
+        return LoadSnapshot(data.data(), data.size(), restored);
+    }
+
+    /*
+        O(1) 取消；句柄已经过期（任务已触发或已删除）时什么都不做，返回 false
+        周期任务可以在自己的回调里取消自己，回调返回后不再调度
+    */
+    bool DelTimer(TimerHandle handle)
+    {
+        TimerNode *node = Lookup(handle);
+        if(node == nullptr)
+        {
+            return false;
+        }
+        // 在线程池里执行的周期任务：回调可能正在读节点，不写节点，记下来由完成通知回收
+        if(node->state == TimerState::Offloaded)
+        {
+            if(node->period == 0 || (offload_ops[node->slot] & kOffloadCancel))
+            {
+                return false;
+            }
+            offload_ops[node->slot] |= kOffloadCancel;
+            StatsBump(stats.cancels);
+            return true;
+        }
+        // 已摘下等待分发的任务、或在自己回调里的周期任务：只做标记，由分发循环回收
+        if(node->state == TimerState::Expired || (node->state == TimerState::Firing && node->period > 0))
+        {
+            node->state = TimerState::Cancelled;
+            StatsBump(stats.cancels);
+            return true;
+        }
+        if(node->state != TimerState::Pending)
+        {
+            return false;
+        }
+        engine->Erase(node);
+        Release(node);
+        StatsBump(stats.cancels);
+        PublishPending();
+        return true;
+    }
+
+    /*
+        原地修改任务的触发时间为 now + msec，节点、句柄、id、slack 都不变，省掉 DelTimer + AddTimer
+        时间轮 / 堆 推迟触发时间时只改节点本身，到期检查时再按新时间调整位置
+        只对还在等待触发的任务有效，句柄过期或任务已经摘下等待执行时返回 false
+    */
+    bool ResetTimer(TimerHandle handle, time_t msec)
+    {
+        return UpdateExpire(handle, now_tick + msec * TicksPerMs(), false);
+    }
+
+    template <class Rep, class Period>
+    bool ResetTimer(TimerHandle handle, std::chrono::duration<Rep, Period> delay)
+    {
+        return UpdateExpire(handle, now_tick + ToTicks(delay), false);
+    }
+
+    // 只推迟不提前：触发时间改为 max(原 expire, now + msec)，适合每收到一个包就续期的空闲超时
+    bool ExtendTimer(TimerHandle handle, time_t msec)
+    {
+        return UpdateExpire(handle, now_tick + msec * TicksPerMs(), true);
+    }
+
+    template <class Rep, class Period>
+    bool ExtendTimer(TimerHandle handle, std::chrono::duration<Rep, Period> delay)
+    {
+        return UpdateExpire(handle, now_tick + ToTicks(delay), true);
+    }
+
+    /*
+        执行所有 expire <= now（tick）的任务，同时刷新缓存的当前时间
+        先把到期任务一次性摘到 expired_batch 里再逐个分发：
+        1）回调里新增的任务（包括已经到期的、周期任务的下一次）留到下一次 HandleTimer 执行
+        2）回调里删除本批次中尚未执行的任务，DelTimer 返回 true，该任务不会执行
+        3）回调里再调用 HandleTimer 直接返回
+        设置了分发预算（SetDispatchBudget）时，超出预算的任务留在 expired_batch 里，
+        下一次 HandleTimer 先执行它们，再摘新的到期任务；此期间 TimeToSleep() 返回 0
+    */
+    void HandleTimer(time_t now)
+    {
+        if(dispatching)
+        {
+            return;
+        }
+        if(now > now_tick)
+        {
+            now_tick = now;
+        }
+
+        if(batch_pos == expired_batch.size())
+        {
+            expired_batch.clear();
+            batch_pos = 0;
+            engine->CollectExpired(now, expired_batch);
+            for(TimerNode *node : expired_batch)
+            {
+                node->state = TimerState::Expired;
+            }
+        }
+
+        dispatching = true;
+        // 相邻两个回调共用一次读时钟：上一个回调的结束时间就是下一个回调的开始时间
+        bool timing = stats_enabled || budget_ns > 0;
+        int64_t clock_ns = timing ? ClockNs() : 0;
+        int64_t deadline_ns = budget_ns > 0 ? clock_ns + budget_ns : 0;
+        size_t callbacks = 0;
+        while(batch_pos < expired_batch.size())
+        {
+            if((budget_callbacks > 0 && callbacks >= budget_callbacks) || (deadline_ns > 0 && clock_ns >= deadline_ns))
+            {
+                break;      // 预算用完，剩下的留到下一轮，先让 loop 回去处理 IO
+            }
+            TimerNode *node = expired_batch[batch_pos++];
+            if(node->state == TimerState::Expired && node->offload && worker_pool != nullptr)
+            {
+                if(stats_enabled)
+                {
+                    int64_t late = clock_ns - static_cast<int64_t>(node->expire) * ns_per_tick;
+                    stats.lateness.Record(late > 0 ? static_cast<uint64_t>(late) : 0);
+                }
+                Offload(node);
+                continue;       // 回收 / 重新调度等完成通知
+            }
+            if(node->state == TimerState::Expired)
+            {
+                node->state = TimerState::Firing;
+                if(timing)
+                {
+                    int64_t late = clock_ns - static_cast<int64_t>(node->expire) * ns_per_tick;
+                    node->func(*node);
+                    int64_t end = ClockNs();
+                    if(stats_enabled)
+                    {
+                        stats.lateness.Record(late > 0 ? static_cast<uint64_t>(late) : 0);
+                        stats.callback.Record(static_cast<uint64_t>(end - clock_ns));
+                    }
+                    clock_ns = end;
+                }
+                else
+                {
+                    node->func(*node);
+                }
+                StatsBump(stats.fired);
+                ++callbacks;
+            }
+            if(node->period > 0 && node->state == TimerState::Firing)
+            {
+                Reschedule(node, now);
+            }
+            else
+            {
+                Release(node);
+            }
+        }
+        dispatching = false;
+        if(batch_pos == expired_batch.size())
+        {
+            expired_batch.clear();
+            batch_pos = 0;
+        }
+        PublishPending();
+
+        if(timer_fd >= 0)
+        {
+            SyncTimerfd();
+        }
+    }
+
+    /*
+        每次 HandleTimer 最多执行 max_callbacks 个回调、最多占用 max_time，0 表示不限制
+        到期任务扎堆时（例如几万个连接同时超时）把分发拆到多轮 loop 里，IO 的延迟有上界
+        时间预算在每个回调之后检查，单个回调本身超时没有办法打断
+    */
+    void SetDispatchBudget(size_t max_callbacks, std::chrono::microseconds max_time = std::chrono::microseconds(0))
+    {
+        budget_callbacks = max_callbacks;
+        budget_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(max_time).count();
+    }
+
+    // 是否有因为预算用完而推迟的到期任务
+    bool HasDeferred() const
+    {
+        return batch_pos < expired_batch.size();
+    }
+
+    // 使用缓存的当前时间，配合 UpdateNow() 使用
+    void HandleTimer()
+    {
+        HandleTimer(now_tick);
+    }
+
+    // 距离最早的任务还有多少毫秒，给 epoll_wait 用；不足 1ms 向上取整，避免提前醒来空转
+    time_t TimeToSleep()
+    {
+        if(HasDeferred())
+        {
+            return 0;
+        }
+        time_t expire = engine->NearestExpire();
+        if(expire < 0)
+        {
+            return -1;
+        }
+        time_t time_gap = expire - ReadClock();
+        return time_gap > 0 ? (time_gap + TicksPerMs() - 1) / TicksPerMs() : 0;
+    }
+
+    // 最早任务的绝对时间（steady_clock 纳秒，即 CLOCK_MONOTONIC），没有任务返回 -1；给按绝对时间等待的 loop 用（如 io_uring 的超时）
+    int64_t NextDeadlineNs() const
+    {
+        time_t expire = HasDeferred() ? now_tick : engine->NearestExpire();
+        return expire < 0 ? -1 : static_cast<int64_t>(expire) * ns_per_tick;
+    }
+
+    size_t Size() const
+    {
+        return engine->Size();
+    }
+
+    // 预先准备 n 个节点，之后 n 个以内的并发任务不会再扩容
+    void Reserve(size_t n)
+    {
+        pool.Reserve(n);
+    }
+
+    // 节点池统计：容量、使用中、历史峰值
+    const TimerPoolStats &PoolStats() const
+    {
+        return pool.Stats();
+    }
+
+    /*
+        运行统计快照：增删次数、执行次数、等待中的任务数，以及触发延迟和回调耗时的直方图
+        任意线程都可以调用；计数是累计值，两次快照用 PerSecond() 算速率
+    */
+    TimerStatsSnapshot Stats() const
+    {
+        TimerStatsSnapshot snapshot;
+        snapshot.time_ns = static_cast<uint64_t>(ClockNs());
+        stats.Snapshot(snapshot);
+        return snapshot;
+    }
+
+    // 关闭后分发时不再读时钟记录触发延迟和回调耗时，计数器照常累计；默认打开
+    void EnableStats(bool enable)
+    {
+        stats_enabled = enable;
+    }
+
+private:
+    static int64_t ClockNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 快照里的触发时间用墙上时间，跨进程 / 重启后仍然有意义
+    static int64_t WallClockNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // 待触发 = 引擎里的 + 本批次还没派发的 + 交给线程池还没执行完的，所有修改任务数的地方都走这里
+    void PublishPending()
+    {
+        stats.pending.store(engine->Size() + (expired_batch.size() - batch_pos) + offloaded, std::memory_order_relaxed);
+    }
+
+    time_t TicksPerMs() const
+    {
+        return 1000000 / ns_per_tick;
+    }
+
+    template <class Rep, class Period>
+    time_t ToTicks(std::chrono::duration<Rep, Period> d) const
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        return static_cast<time_t>((ns + ns_per_tick - 1) / ns_per_tick);
+    }
+
+    // slack 向下取整到 tick，保证不会超出调用者允许的范围
+    time_t SlackTicks(std::chrono::nanoseconds slack) const
+    {
+        return slack.count() > 0 ? static_cast<time_t>(slack.count() / ns_per_tick) : 0;
+    }
+
+    /*
+        在 [due, due + slack] 内选一个对齐到 2^k 的时刻（2^k 是不超过 slack 的最大 2 的幂）：
+        同一网格上的任务 expire 完全相同，引擎里挨在一起，一次唤醒全部到期
+    */
+    static time_t Coalesce(time_t due, time_t slack)
+    {
+        if(slack <= 0)
+        {
+            return due;
+        }
+        time_t grain = time_t(1) << (63 - __builtin_clzll(static_cast<uint64_t>(slack)));
+        return (due + grain - 1) & ~(grain - 1);
+    }
+
+    TimerHandle Schedule(time_t delay, time_t period, TimerNode::Cb func, TimerMissPolicy policy, time_t slack)
+    {
+        return ScheduleAt(now_tick + delay, period, std::move(func), policy, slack);
+    }
+
+    // 所有 AddTimer 的公共实现，due / period / slack 单位都是 tick，period 为 0 表示一次性任务
+    TimerHandle ScheduleAt(time_t due, time_t period, TimerNode::Cb func, TimerMissPolicy policy, time_t slack)
+    {
+        TimerNode *node = pool.Acquire();
+        node->due = due;
+        node->slack = slack;
+        node->expire = Coalesce(due, slack);
+        node->id = GenID();
+        node->func = std::move(func);
+        node->period = period;
+        node->miss_policy = policy;
+        node->state = TimerState::Pending;
+        engine->Insert(node);
+        StatsBump(stats.adds);
+        PublishPending();
+        // 删除任务时不动 timerfd，最多多一次空唤醒；只有新任务更早时才重新设置
+        if(timer_fd >= 0 && (armed_expire < 0 || node->expire < armed_expire))
+        {
+            ArmTimerfd(node->expire);
+        }
+        return TimerHandle{node->slot, node->gen};
+    }
+
+    // payload 按节点下标存放；deque 在尾部扩容时已有元素的地址不变，回调（包括在线程池里执行的）直接持有指针
+    void Persist(TimerNode *node, uint32_t type, const TimerTypeRegistry::Handler *handler, std::string payload)
+    {
+        if(node->slot >= payloads.size())
+        {
+            payloads.resize(node->slot + 1);
+        }
+        std::string &slot_payload = payloads[node->slot];
+        slot_payload = std::move(payload);
+        const std::string *data = &slot_payload;
+        node->type_tag = type;
+        node->func = [handler, data](const TimerNode &fired) {
+            (*handler)(fired, *data);
+        };
+    }
+
+    bool UpdateExpire(TimerHandle handle, time_t due, bool extend_only)
+    {
+        TimerNode *node = Lookup(handle);
+        if(node == nullptr || node->state != TimerState::Pending)
+        {
+            return false;
+        }
+        if(extend_only && due < node->due)
+        {
+            return true;
+        }
+        node->due = due;
+        StatsBump(stats.resets);
+        // 有 slack 的任务续期后多半还落在同一个网格点上，不需要动引擎
+        time_t expire = Coalesce(due, node->slack);
+        if(expire == node->expire)
+        {
+            return true;
+        }
+        engine->Update(node, expire);
+        // 推迟时不动 timerfd，最多多一次空唤醒
+        if(timer_fd >= 0 && (armed_expire < 0 || expire < armed_expire))
+        {
+            ArmTimerfd(expire);
+        }
+        return true;
+    }
+
+    // 把 timerfd 设置到绝对时间 expire（steady_clock 与 CLOCK_MONOTONIC 是同一个时钟），expire < 0 表示关闭
+    void ArmTimerfd(time_t expire)
+    {
+        itimerspec spec = {};
+        if(expire >= 0)
+        {
+            int64_t ns = static_cast<int64_t>(expire) * ns_per_tick;
+            spec.it_value.tv_sec = ns / 1000000000;
+            spec.it_value.tv_nsec = ns % 1000000000;
+            if(spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+            {
+                spec.it_value.tv_nsec = 1;      // 全 0 表示关闭定时器
+            }
+        }
+        timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr);
+        armed_expire = expire;
+    }
+
+    // 还有推迟的任务时把 timerfd 设置到已经过去的时间，fd 立即可读，loop 处理完这一轮 IO 后马上回来继续分发
+    void SyncTimerfd()
+    {
+        time_t expire = HasDeferred() ? now_tick : engine->NearestExpire();
+        if(expire != armed_expire)
+        {
+            ArmTimerfd(expire);
+        }
+    }
+
+    // 交给线程池执行；线程池里只读节点，执行完把节点放回完成列表，列表由空变非空时写 eventfd 唤醒 loop
+    void Offload(TimerNode *node)
+    {
+        if(node->slot >= offload_ops.size())
+        {
+            offload_ops.resize(pool.Stats().capacity > node->slot ? pool.Stats().capacity : node->slot + 1);
+        }
+        offload_ops[node->slot] = 0;
+        node->state = TimerState::Offloaded;
+        ++offloaded;
+        StatsBump(stats.fired);
+        worker_pool->Submit([this, node] {
+            node->func(*node);
+            bool first;
+            {
+                std::lock_guard<std::mutex> lock(offload_mutex);
+                first = offload_done.empty();
+                offload_done.push_back(node);
+            }
+            if(first)
+            {
+                uint64_t one = 1;
+                ssize_t ret = write(offload_fd, &one, sizeof(one));
+                (void)ret;
+            }
+        });
+    }
+
+    // 周期任务按原定的 due 推进一个周期（对齐误差不会累积），落后时按 miss_policy 处理
+    void Reschedule(TimerNode *node, time_t now)
+    {
+        node->due += node->period;
+        if(node->due <= now && node->miss_policy == TimerMissPolicy::Skip)
+        {
+            node->due += ((now - node->due) / node->period + 1) * node->period;
+        }
+        node->expire = Coalesce(node->due, node->slack);
+        node->state = TimerState::Pending;
+        engine->Insert(node);
+    }
+
+    TimerNode *Lookup(TimerHandle handle) const
+    {
+        TimerNode *node = pool.Get(handle.slot);
+        return (node != nullptr && node->gen == handle.gen) ? node : nullptr;
+    }
+
+    // 回收节点：释放回调持有的资源，代数加一让旧句柄失效
+    void Release(TimerNode *node)
+    {
+        node->func = nullptr;
+        node->state = TimerState::Free;
+        node->offload = false;
+        if(node->type_tag != 0)
+        {
+            std::string().swap(payloads[node->slot]);
+            node->type_tag = 0;
+        }
+        ++node->gen;
+        pool.Release(node);
+    }
+
+    /*
+        返回任务id：实例号(高 24 位) | 实例内计数(低 40 位)
+        实例号只在构造时领取一次，之后生成 id 只是本实例的普通自增，多个线程各自的 Timer 之间没有共享的计数器
+        id 只用来决定同一 expire 下的先后顺序，不保证唯一：
+        1）低 40 位按每秒一千万个任务算要三十多小时才回绕，回绕后可能和还没触发的任务 id 相同
+        2）实例号构造 2^24 个 Timer 后回绕，不同实例的 id 可能相同
+        相同时各引擎照常工作：set 引擎最后按 slot 比较，堆和时间轮本来就允许重复，只是同一 expire 下的先后顺序不再是添加顺序
+    */
+    uint64_t GenID()
+    {
+        return id_prefix | (next_id++ & kIdSeqMask);
+    }
+
+    static uint64_t NextInstancePrefix()
+    {
+        static std::atomic<uint64_t> instances{0};
+        return (instances.fetch_add(1, std::memory_order_relaxed) & kIdPrefixMask) << kIdSeqBits;
+    }
+
+    // offload_ops 的取值
+    static constexpr uint8_t kOffloadCancel = 1 << 0;
+    static constexpr uint8_t kOffloadOn = 1 << 1;      // SetOffload(true)
+    static constexpr uint8_t kOffloadOff = 1 << 2;     // SetOffload(false)
+
+    static constexpr int kIdSeqBits = 40;
+    static constexpr uint64_t kIdSeqMask = (uint64_t(1) << kIdSeqBits) - 1;
+    static constexpr uint64_t kIdPrefixMask = (uint64_t(1) << (64 - kIdSeqBits)) - 1;
+
+    TimerNodePool pool;     // 节点池，下标即句柄中的 slot；必须晚于 engine 析构
+    std::unique_ptr<TimerEngine> engine;
+    TimerResolution resolution;
+    int64_t ns_per_tick;        // 每个 tick 多少纳秒
+    time_t now_tick;            // 缓存的当前时间
+    uint64_t id_prefix = NextInstancePrefix();  // 本实例的 id 高位
+    uint64_t next_id = 0;
+    std::vector<TimerNode *> expired_batch;     // 本轮到期的任务，连续存放，内存复用
+    size_t batch_pos = 0;       // expired_batch 中下一个待分发的位置，之前的已经处理完
+    size_t budget_callbacks = 0;
+    int64_t budget_ns = 0;
+    bool dispatching = false;
+    int timer_fd = -1;
+    time_t armed_expire = -1;   // timerfd 当前设置的触发时间，-1 表示未设置
+    bool stats_enabled = true;
+    TimerStats stats;
+    WorkStealingPool *worker_pool = nullptr;
+    int offload_fd = -1;
+    size_t offloaded = 0;
+    std::mutex offload_mutex;                   // 保护 offload_done，工作线程和 loop 线程共用
+    std::vector<TimerNode *> offload_done;      // 执行完、等待 loop 线程回收的任务
+    std::vector<uint8_t> offload_ops;           // 节点下标 -> 在线程池执行期间推迟的操作，只在 loop 线程访问
+    std::vector<TimerNode *> offload_batch;     // loop 线程换出来处理的那一批
+    const TimerTypeRegistry *type_registry = nullptr;
+    std::deque<std::string> payloads;           // 节点下标 -> 持久化任务的 payload
+};
+
+#endif
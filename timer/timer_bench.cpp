@@ -0,0 +1,446 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "timer.h"
+#include "timer_map.h"
+
+using namespace std;
+
+/*
+    定时器微基准：比较 set / multiset(timer_map) / 时间轮 / 4 叉堆 等实现
+    操作：
+        add     空定时器里连续添加 N 个任务，逐个计时
+        cancel  预先放入 N 个任务，按随机顺序逐个删除并计时
+        fire    预先放入 N 个任务，时间分 1000 步推进，每次 HandleTimer 计时（延迟按"步"统计）
+        churn   保持 N 个待触发任务，每轮 添加一个 + 随机删除一个 + HandleTimer(当前时间)，逐轮计时
+        extend  预先放入 N 个任务，随机挑选任务续期（空闲超时的典型用法），逐个计时；multiset 只能删除再添加
+        restore 把 N 个持久化任务的快照恢复到空定时器（LoadSnapshot，引擎批量建结构），整体计时；multiset 没有快照，逐个添加
+        reload  同一个定时器保存快照后再恢复到自己身上（任务数翻倍），整体计时；之后全部触发，次数不是 2N 时输出到 stderr
+    分布：uniform 均匀分布在 span 内，clustered 集中在 8 个时间点附近，same 全部同一时刻
+    每个用例输出一行 JSON，方便长期记录和对比：
+        ./timer_bench --backends set,wheel,heap,multiset --ops add,fire --dist uniform --sizes 1000,1000000
+    单次计时本身有几十纳秒的 steady_clock 开销，比较不同实现时可以忽略
+*/
+
+namespace {
+
+struct Options
+{
+    vector<string> backends = {"set", "wheel", "heap", "multiset"};
+    vector<string> ops = {"add", "cancel", "fire", "churn", "extend", "restore", "reload"};
+    vector<string> dists = {"uniform", "clustered", "same"};
+    vector<size_t> sizes = {1000, 10000, 100000, 1000000};
+    size_t churn_iters = 200000;    // churn / extend 每个用例最多跑多少轮
+    time_t span = 60000;            // 任务延时范围（毫秒）
+    uint64_t seed = 42;
+    bool stats = false;             // Timer 默认记录触发延迟 / 回调耗时，对比纯数据结构开销时关掉
+};
+
+struct Result
+{
+    double seconds = 0;
+    size_t ops = 0;
+    vector<uint64_t> latencies;     // 纳秒
+    const char *unit = "op";
+};
+
+inline uint64_t NowNs()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 按分布生成 n 个延时（毫秒）
+vector<time_t> MakeDelays(const string &dist, size_t n, time_t span, mt19937_64 &rng)
+{
+    vector<time_t> delays(n);
+    if(dist == "same")
+    {
+        fill(delays.begin(), delays.end(), span / 2);
+    }
+    else if(dist == "clustered")
+    {
+        time_t centers[8];
+        for(auto &center : centers)
+        {
+            center = 1 + static_cast<time_t>(rng() % span);
+        }
+        for(auto &delay : delays)
+        {
+            delay = max<time_t>(1, centers[rng() % 8] + static_cast<time_t>(rng() % 11) - 5);
+        }
+    }
+    else
+    {
+        for(auto &delay : delays)
+        {
+            delay = 1 + static_cast<time_t>(rng() % span);
+        }
+    }
+    return delays;
+}
+
+// timer.h 中的 Timer，按引擎区分
+struct TimerAdapter
+{
+    using Handle = TimerHandle;
+
+    TimerAdapter(TimerBackend backend, bool stats) : backend(backend), timer(backend)
+    {
+        timer.EnableStats(stats);
+    }
+
+    Handle Add(time_t msec, uint64_t *counter)
+    {
+        return timer.AddTimer(msec, [counter](const TimerNode &) { ++*counter; });
+    }
+
+    bool Cancel(Handle handle)
+    {
+        return timer.DelTimer(handle);
+    }
+
+    void Extend(Handle &handle, time_t msec, uint64_t *)
+    {
+        timer.ExtendTimer(handle, msec);
+    }
+
+    void Fire(time_t now)
+    {
+        timer.HandleTimer(now);
+    }
+
+    // 添加持久化任务并保存快照，不计时；reload 时任务留在 timer 自己身上，否则放在另一个 Timer 里
+    void PrepareRestore(const vector<time_t> &delays, uint64_t *counter, bool reload)
+    {
+        registry.Register(1, [counter](const TimerNode &, const string &) { ++*counter; });
+        timer.SetTypeRegistry(&registry);
+        Timer other(backend);
+        other.SetTypeRegistry(&registry);
+        Timer &source = reload ? timer : other;
+        for(time_t msec : delays)
+        {
+            source.AddPersistentTimer(msec, 1, string());
+        }
+        source.SaveSnapshot(snapshot);
+    }
+
+    void Restore()
+    {
+        timer.LoadSnapshot(snapshot);
+    }
+
+    TimerBackend backend;
+    TimerTypeRegistry registry;     // 必须比 timer 晚析构
+    string snapshot;
+    Timer timer;
+};
+
+// timer_map.h 中基于 multiset 的 Timer
+struct MultisetAdapter
+{
+    using Handle = timer_map::TimerNodeBase;
+
+    Handle Add(time_t msec, uint64_t *counter)
+    {
+        return timer.addTimer(msec, [counter]() { ++*counter; });
+    }
+
+    bool Cancel(Handle handle)
+    {
+        return timer.delTimer(handle);
+    }
+
+    void Extend(Handle &handle, time_t msec, uint64_t *counter)
+    {
+        timer.delTimer(handle);
+        handle = Add(msec, counter);
+    }
+
+    void Fire(time_t now)
+    {
+        timer.HandleTimer(now);
+    }
+
+    void PrepareRestore(const vector<time_t> &delays, uint64_t *counter, bool reload)
+    {
+        pending = &delays;
+        fired = counter;
+        if(reload)
+        {
+            Restore();
+        }
+    }
+
+    void Restore()
+    {
+        for(time_t msec : *pending)
+        {
+            Add(msec, fired);
+        }
+    }
+
+    timer_map::Timer timer;
+    const vector<time_t> *pending = nullptr;
+    uint64_t *fired = nullptr;
+};
+
+template <class Adapter, class Factory>
+Result RunCase(Factory make, const string &op, const vector<time_t> &delays, const Options &opt, mt19937_64 &rng)
+{
+    Result result;
+    uint64_t fired = 0;
+    size_t n = delays.size();
+    auto adapter = make();
+    vector<typename Adapter::Handle> handles;
+    handles.reserve(n);
+
+    if(op == "add")
+    {
+        result.latencies.reserve(n);
+        uint64_t begin = NowNs();
+        for(size_t i = 0; i < n; ++i)
+        {
+            uint64_t t0 = NowNs();
+            handles.push_back(adapter->Add(delays[i], &fired));
+            result.latencies.push_back(NowNs() - t0);
+        }
+        result.seconds = (NowNs() - begin) / 1e9;
+        result.ops = n;
+        return result;
+    }
+
+    if(op == "restore" || op == "reload")
+    {
+        time_t base = Timer::GetTick();
+        adapter->PrepareRestore(delays, &fired, op == "reload");
+        result.unit = "load";
+        uint64_t begin = NowNs();
+        adapter->Restore();
+        uint64_t elapsed = NowNs() - begin;
+        result.latencies.push_back(elapsed);
+        result.seconds = elapsed / 1e9;
+        result.ops = n;
+        if(op == "reload")
+        {
+            // 恢复的任务和原来的任务触发时间、id 都可能相同，一个都不能丢
+            adapter->Fire(base + opt.span + 1000);
+            if(fired != 2 * n)
+            {
+                fprintf(stderr, "reload: fired %lu of %zu\n", static_cast<unsigned long>(fired), 2 * n);
+            }
+        }
+        return result;
+    }
+
+    time_t base = Timer::GetTick();
+    for(size_t i = 0; i < n; ++i)
+    {
+        handles.push_back(adapter->Add(delays[i], &fired));
+    }
+
+    if(op == "cancel")
+    {
+        shuffle(handles.begin(), handles.end(), rng);
+        result.latencies.reserve(n);
+        uint64_t begin = NowNs();
+        for(auto &handle : handles)
+        {
+            uint64_t t0 = NowNs();
+            adapter->Cancel(handle);
+            result.latencies.push_back(NowNs() - t0);
+        }
+        result.seconds = (NowNs() - begin) / 1e9;
+        result.ops = n;
+    }
+    else if(op == "fire")
+    {
+        // 预加载期间时钟在走，多留出加载耗时，保证最后一步全部到期
+        time_t end = Timer::GetTick() + opt.span + 1;
+        const int steps = 1000;
+        result.latencies.reserve(steps);
+        result.unit = "step";
+        uint64_t begin = NowNs();
+        for(int step = 1; step <= steps; ++step)
+        {
+            time_t now = base + (end - base) * step / steps;
+            uint64_t t0 = NowNs();
+            adapter->Fire(now);
+            result.latencies.push_back(NowNs() - t0);
+        }
+        result.seconds = (NowNs() - begin) / 1e9;
+        result.ops = fired;
+    }
+    else if(op == "churn")
+    {
+        size_t iters = min(opt.churn_iters, max<size_t>(n, 1000));
+        vector<time_t> more = MakeDelays("uniform", iters, opt.span, rng);
+        result.latencies.reserve(iters);
+        uint64_t begin = NowNs();
+        for(size_t i = 0; i < iters; ++i)
+        {
+            size_t victim = rng() % n;
+            uint64_t t0 = NowNs();
+            adapter->Cancel(handles[victim]);
+            handles[victim] = adapter->Add(more[i], &fired);
+            adapter->Fire(Timer::GetTick());
+            result.latencies.push_back(NowNs() - t0);
+        }
+        result.seconds = (NowNs() - begin) / 1e9;
+        result.ops = iters;
+    }
+    else if(op == "extend")
+    {
+        size_t iters = min(opt.churn_iters, max<size_t>(n, 1000));
+        result.latencies.reserve(iters);
+        uint64_t begin = NowNs();
+        for(size_t i = 0; i < iters; ++i)
+        {
+            size_t victim = rng() % n;
+            uint64_t t0 = NowNs();
+            adapter->Extend(handles[victim], opt.span, &fired);
+            result.latencies.push_back(NowNs() - t0);
+        }
+        result.seconds = (NowNs() - begin) / 1e9;
+        result.ops = iters;
+    }
+    return result;
+}
+
+uint64_t Percentile(vector<uint64_t> &values, double p)
+{
+    if(values.empty())
+    {
+        return 0;
+    }
+    size_t k = min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+void Report(const string &backend, const string &op, const string &dist, size_t pending, Result &r)
+{
+    uint64_t p50 = Percentile(r.latencies, 0.50);
+    uint64_t p99 = Percentile(r.latencies, 0.99);
+    uint64_t p999 = Percentile(r.latencies, 0.999);
+    printf("{\"bench\":\"timer\",\"time\":%ld,\"backend\":\"%s\",\"op\":\"%s\",\"dist\":\"%s\",\"pending\":%zu,"
+           "\"ops\":%zu,\"seconds\":%.6f,\"mops\":%.3f,\"latency_unit\":\"%s\",\"p50_ns\":%lu,\"p99_ns\":%lu,\"p999_ns\":%lu}\n",
+           static_cast<long>(time(nullptr)), backend.c_str(), op.c_str(), dist.c_str(), pending,
+           r.ops, r.seconds, r.seconds > 0 ? r.ops / r.seconds / 1e6 : 0.0, r.unit,
+           static_cast<unsigned long>(p50), static_cast<unsigned long>(p99), static_cast<unsigned long>(p999));
+    fflush(stdout);
+}
+
+vector<string> Split(const char *arg)
+{
+    vector<string> out;
+    string item;
+    for(const char *p = arg; ; ++p)
+    {
+        if(*p == ',' || *p == '\0')
+        {
+            if(!item.empty())
+                out.push_back(item);
+            item.clear();
+            if(*p == '\0')
+                break;
+        }
+        else
+        {
+            item += *p;
+        }
+    }
+    return out;
+}
+
+bool ParseArgs(int argc, char *argv[], Options &opt)
+{
+    for(int i = 1; i < argc; ++i)
+    {
+        if(i + 1 >= argc)
+        {
+            return false;
+        }
+        const char *value = argv[i + 1];
+        if(strcmp(argv[i], "--backends") == 0)
+            opt.backends = Split(value);
+        else if(strcmp(argv[i], "--ops") == 0)
+            opt.ops = Split(value);
+        else if(strcmp(argv[i], "--dist") == 0)
+            opt.dists = Split(value);
+        else if(strcmp(argv[i], "--sizes") == 0)
+        {
+            opt.sizes.clear();
+            for(auto &size : Split(value))
+                opt.sizes.push_back(strtoull(size.c_str(), nullptr, 10));
+        }
+        else if(strcmp(argv[i], "--churn-iters") == 0)
+            opt.churn_iters = strtoull(value, nullptr, 10);
+        else if(strcmp(argv[i], "--span") == 0)
+            opt.span = strtoll(value, nullptr, 10);
+        else if(strcmp(argv[i], "--seed") == 0)
+            opt.seed = strtoull(value, nullptr, 10);
+        else if(strcmp(argv[i], "--stats") == 0)
+            opt.stats = strcmp(value, "0") != 0;
+        else
+            return false;
+        ++i;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    Options opt;
+    if(!ParseArgs(argc, argv, opt))
+    {
+        fprintf(stderr, "usage: %s [--backends set,wheel,heap,multiset] [--ops add,cancel,fire,churn,extend,restore,reload] "
+                        "[--dist uniform,clustered,same] [--sizes 1000,...,10000000] "
+                        "[--churn-iters N] [--span MS] [--seed N] [--stats 0|1]\n", argv[0]);
+        return 1;
+    }
+
+    for(size_t n : opt.sizes)
+    {
+        for(const string &dist : opt.dists)
+        {
+            mt19937_64 rng(opt.seed);
+            vector<time_t> delays = MakeDelays(dist, n, opt.span, rng);
+            for(const string &op : opt.ops)
+            {
+                for(const string &backend : opt.backends)
+                {
+                    mt19937_64 case_rng(opt.seed + 1);
+                    Result r;
+                    if(backend == "multiset")
+                    {
+                        r = RunCase<MultisetAdapter>([] { return make_unique<MultisetAdapter>(); }, op, delays, opt, case_rng);
+                    }
+                    else if(backend == "set" || backend == "wheel" || backend == "heap")
+                    {
+                        TimerBackend engine = backend == "wheel" ? TimerBackend::Wheel
+                                            : backend == "heap" ? TimerBackend::Heap : TimerBackend::Set;
+                        bool stats = opt.stats;
+                        r = RunCase<TimerAdapter>([engine, stats] { return make_unique<TimerAdapter>(engine, stats); },
+                                                  op, delays, opt, case_rng);
+                    }
+                    else
+                    {
+                        fprintf(stderr, "unknown backend: %s\n", backend.c_str());
+                        return 1;
+                    }
+                    Report(backend, op, dist, n, r);
+                }
+            }
+        }
+    }
+    return 0;
+}
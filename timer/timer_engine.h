@@ -0,0 +1,126 @@
+#ifndef __TIMER_ENGINE_H__
+#define __TIMER_ENGINE_H__
+
+#include <cstdint>
+#include <ctime>
+#include <vector>
+
+#include "small_function.h"
+
+/* 定时任务节点，以及定时器存储引擎的公共接口 */
+
+struct TimerNodeBase
+{
+    time_t expire;  // 触发事件, Now + 定时时间
+    uint64_t id;    // 由于时间可能重复，所以用 id 唯一表示定时任务
+};
+
+/*
+    定时任务句柄：节点表下标 + 代数
+    节点回收时代数加一，旧句柄自然失效，DelTimer 不需要任何查找
+*/
+struct TimerHandle
+{
+    uint32_t slot = 0;
+    uint32_t gen = 0;       // 节点的代数从 1 开始，默认构造的句柄永远无效
+};
+
+// 侵入式双向链表钩子，时间轮的格子用它串起节点
+struct TimerLink
+{
+    TimerLink *prev;
+    TimerLink *next;
+};
+
+enum class TimerState : uint8_t
+{
+    Free,       // 空闲，在 Timer 的空闲表里
+    Pending,    // 在引擎中等待触发
+    Expired,    // 已从引擎批量摘下，在分发缓冲区里等待执行
+    Firing,     // 回调执行中
+    Cancelled,  // 摘下后被 DelTimer（还没执行，或周期任务在自己的回调里取消），由分发循环回收
+    Offloaded,  // 回调已交给工作线程池，等待完成通知
+};
+
+// 周期任务落后（loop 卡顿超过一个周期）时的处理方式
+enum class TimerMissPolicy : uint8_t
+{
+    Skip,       // 跳过错过的周期，对齐到 now 之后的下一个周期点
+    CatchUp,    // 逐个补发错过的周期
+};
+
+struct TimerNode : public TimerNodeBase, public TimerLink
+{
+    using Cb = SmallFunction<void(const TimerNode &node)>;    // 只能移动，捕获放在节点内部
+
+    Cb func;
+    time_t period = 0;      // 周期，0 表示一次性任务
+    time_t due = 0;         // 要求的触发时间；expire 是在 [due, due + slack] 内对齐后的时间
+    time_t slack = 0;       // 允许推迟的时间，0 表示精确触发
+    uint32_t slot = 0;      // 在 Timer 节点表中的下标
+    uint32_t gen = 1;       // 代数，与 TimerHandle::gen 比较判断句柄是否过期
+    TimerState state = TimerState::Free;
+    TimerMissPolicy miss_policy = TimerMissPolicy::Skip;
+    bool offload = false;   // 回调在工作线程池执行
+    uint16_t bucket = 0;    // 引擎内部使用：时间轮的格子编号
+    uint32_t heap_index = 0;    // 引擎内部使用：在堆数组中的下标
+    uint32_t type_tag = 0;      // 持久化任务的类型编号，0 表示普通任务
+
+    TimerNode()
+        {
+            this->expire = 0;
+            this->id = 0;
+            this->prev = this->next = nullptr;
+        }
+};
+
+inline bool operator < (const TimerNodeBase &LTimer, const TimerNodeBase &RTimer)
+{
+    if(LTimer.expire < RTimer.expire)
+        return true;
+    else if(LTimer.expire > RTimer.expire)
+        return false;
+    else
+        return LTimer.id < RTimer.id;       // 如果触发时间相等，则id的大放在后面触发
+}
+
+/*
+    定时任务的存储引擎接口，节点由 Timer 持有，引擎只负责按 expire 组织节点：
+    1）Insert       插入节点
+    2）Erase        删除一个仍在引擎中的节点
+    3）CollectExpired  一次性摘下所有 expire <= now 的节点，按触发顺序追加到 out
+    4）NearestExpire  最早的触发时间，没有任务时返回 -1；允许比真实值早（延迟更新的引擎），只会多一次空唤醒
+    5）Update       修改一个仍在引擎中的节点的触发时间，由引擎负责写 node->expire
+    6）BulkLoad     一次插入一批节点（恢复快照用），引擎可以整体建结构而不是逐个插入；允许重排 nodes
+*/
+class TimerEngine
+{
+public:
+    virtual ~TimerEngine() = default;
+
+    virtual void Insert(TimerNode *node) = 0;
+    virtual void Erase(TimerNode *node) = 0;
+
+    // 默认实现：删除后按新时间重新插入
+    virtual void Update(TimerNode *node, time_t expire)
+    {
+        Erase(node);
+        node->expire = expire;
+        Insert(node);
+    }
+
+    // 默认实现：逐个插入
+    virtual void BulkLoad(std::vector<TimerNode *> &nodes)
+    {
+        for(TimerNode *node : nodes)
+        {
+            Insert(node);
+        }
+    }
+
+    virtual void CollectExpired(time_t now, std::vector<TimerNode *> &out) = 0;
+    virtual time_t NearestExpire() const = 0;
+    virtual size_t Size() const = 0;
+};
+
+#endif
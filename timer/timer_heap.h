@@ -0,0 +1,176 @@
+#ifndef __TIMER_HEAP_H__
+#define __TIMER_HEAP_H__
+
+#include <cstdint>
+#include <vector>
+
+#include "timer_engine.h"
+
+/*
+    4 叉小根堆引擎，整个堆是一段连续数组：
+    1）数组元素里直接存 expire / id，比较时不需要访问节点，下沉时一次比较 4 个相邻的孩子
+    2）节点记录自己在堆中的下标（heap_index），删除、提前触发时间都是 O(log n) 的上浮 / 下沉，不需要查找
+       推迟触发时间只改节点，堆里保留旧的（更早的）时间，到达堆顶时再按新时间下沉，续期几乎没有开销
+    3）4 叉比 2 叉层数少一半，下沉时孩子在同一段内存里，缓存更友好
+*/
+
+class HeapTimerEngine : public TimerEngine
+{
+public:
+    static constexpr size_t kArity = 4;
+
+    void Insert(TimerNode *node) override
+    {
+        heap.push_back(Entry{node->expire, node->id, node});
+        SiftUp(heap.size() - 1);
+    }
+
+    void Erase(TimerNode *node) override
+    {
+        RemoveAt(node->heap_index);
+    }
+
+    // 堆中的 expire 始终 <= 节点的 expire：提前时立即上浮，推迟时延迟到 CollectExpired 处理
+    void Update(TimerNode *node, time_t expire) override
+    {
+        node->expire = expire;
+        size_t i = node->heap_index;
+        if(expire < heap[i].expire)
+        {
+            heap[i].expire = expire;
+            SiftUp(i);
+        }
+    }
+
+    // 全部追加到数组末尾后自底向上建堆（Floyd），O(n)，比逐个上浮的 O(n log n) 快
+    void BulkLoad(std::vector<TimerNode *> &nodes) override
+    {
+        heap.reserve(heap.size() + nodes.size());
+        for(TimerNode *node : nodes)
+        {
+            heap.push_back(Entry{node->expire, node->id, node});
+        }
+        for(size_t i = 0; i < heap.size(); ++i)
+        {
+            heap[i].node->heap_index = static_cast<uint32_t>(i);
+        }
+        // 最后一个有孩子的位置是 Parent(size - 1)，从它往前逐个下沉
+        for(size_t i = heap.size() > 1 ? Parent(heap.size() - 1) + 1 : 0; i-- > 0; )
+        {
+            SiftDown(i);
+        }
+    }
+
+    // 逐个弹出堆顶，弹出顺序就是触发顺序；堆顶的时间已过期（被推迟过）时按新时间下沉
+    void CollectExpired(time_t now, std::vector<TimerNode *> &out) override
+    {
+        while(!heap.empty() && heap[0].expire <= now)
+        {
+            TimerNode *node = heap[0].node;
+            if(node->expire != heap[0].expire)
+            {
+                heap[0].expire = node->expire;
+                SiftDown(0);
+                continue;
+            }
+            out.push_back(node);
+            RemoveAt(0);
+        }
+    }
+
+    time_t NearestExpire() const override
+    {
+        return heap.empty() ? -1 : heap[0].expire;
+    }
+
+    size_t Size() const override
+    {
+        return heap.size();
+    }
+
+private:
+    struct Entry
+    {
+        time_t expire;
+        uint64_t id;
+        TimerNode *node;
+    };
+
+    static bool Less(const Entry &l, const Entry &r)
+    {
+        return l.expire < r.expire || (l.expire == r.expire && l.id < r.id);
+    }
+
+    static size_t Parent(size_t i)
+    {
+        return (i - 1) / kArity;
+    }
+
+    void Place(size_t i, const Entry &entry)
+    {
+        heap[i] = entry;
+        entry.node->heap_index = static_cast<uint32_t>(i);
+    }
+
+    void SiftUp(size_t i)
+    {
+        Entry entry = heap[i];
+        while(i > 0 && Less(entry, heap[Parent(i)]))
+        {
+            Place(i, heap[Parent(i)]);
+            i = Parent(i);
+        }
+        Place(i, entry);
+    }
+
+    void SiftDown(size_t i)
+    {
+        Entry entry = heap[i];
+        size_t n = heap.size();
+        for(;;)
+        {
+            size_t first = i * kArity + 1;
+            if(first >= n)
+            {
+                break;
+            }
+            size_t last = first + kArity < n ? first + kArity : n;
+            size_t best = first;
+            for(size_t child = first + 1; child < last; ++child)
+            {
+                if(Less(heap[child], heap[best]))
+                {
+                    best = child;
+                }
+            }
+            if(!Less(heap[best], entry))
+            {
+                break;
+            }
+            Place(i, heap[best]);
+            i = best;
+        }
+        Place(i, entry);
+    }
+
+    // 用最后一个元素填补 i，再按它和父节点的大小决定上浮还是下沉
+    void RemoveAt(size_t i)
+    {
+        size_t last = heap.size() - 1;
+        if(i != last)
+        {
+            heap[i] = heap[last];
+            heap.pop_back();
+            if(i > 0 && Less(heap[i], heap[Parent(i)]))
+                SiftUp(i);
+            else
+                SiftDown(i);
+            return;
+        }
+        heap.pop_back();
+    }
+
+    std::vector<Entry> heap;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef __TIMER_MAP_H__
+#define __TIMER_MAP_H__
+
+#include <set>
+#include <chrono>
+#include <ctime>
+
+#include "small_function.h"
+
+/* 用 multiset 作为容器的简易定时器，只按 expire 排序 */
+
+namespace timer_map {
+
+struct TimerNodeBase
+{
+    time_t expire_;
+};
+
+struct TimerNode : public TimerNodeBase
+{
+    using cb = SmallFunction<void()>;
+
+    cb func_;
+
+    TimerNode(time_t expire, cb func)
+        : func_(std::move(func))
+        {
+            this->expire_ = expire;
+        }
+};
+
+inline bool operator < (const TimerNodeBase &LTimer, const TimerNodeBase &RTimer)
+{
+    return LTimer.expire_ < RTimer.expire_;
+}
+
+class Timer 
+{
+public:
+    // 返回 expire，作为 delTimer 的参数
+    TimerNodeBase addTimer(time_t msc, TimerNode::cb func)
+    {
+        time_t expire = GetTick() + msc;
+        timer_set.emplace(expire, std::move(func));
+        return TimerNodeBase{expire};
+    }
+
+    // expire 相同的任务无法区分，删除的是其中任意一个
+    bool delTimer(const TimerNodeBase &node)
+    {
+        auto it = timer_set.find(node);
+        if(it != timer_set.end())
+        {
+            timer_set.erase(it);    // 按迭代器删除，按值删除会把 expire 相同的任务全部删掉
+            return true;
+        }
+        return false;
+    }
+
+    void HandleTimer(time_t now)
+    {
+        auto iter = timer_set.begin();
+        while(iter != timer_set.end() && iter->expire_ <= now)
+        {
+            iter->func_();
+            iter = timer_set.erase(iter);
+        }
+    }
+
+    time_t TimeToSleep()
+    {
+        if(0 == timer_set.size())
+        {
+            return -1;
+        }
+        time_t time_gap = timer_set.begin()->expire_ - GetTick();
+        return time_gap > 0 ? time_gap : 0;
+    }
+
+    // 返回从 steady_clock（通常是程序启动时间）到当前时间的毫秒数  
+    static time_t GetTick()
+    {
+        auto sc = std::chrono::time_point_cast<std::chrono::microseconds>(std::chrono::steady_clock::now());
+        auto tmp = std::chrono::duration_cast<std::chrono::milliseconds>(sc.time_since_epoch());
+        return tmp.count();
+    }
+
+private:
+    std::multiset<TimerNode, std::less<>> timer_set;
+};
+
+} // namespace timer_map
+
+#endif
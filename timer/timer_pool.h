@@ -0,0 +1,227 @@
+#ifndef __TIMER_POOL_H__
+#define __TIMER_POOL_H__
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "timer_engine.h"
+
+/*
+    定时器节点的 slab 池：
+    按块（chunk）整块申请节点，块一旦申请就不再释放，节点地址在 Timer 生命周期内保持不变；
+    空闲节点借用 TimerLink::next 串成侵入式空闲链表，稳态下的申请 / 回收不触发任何堆分配。
+*/
+
+struct TimerPoolStats
+{
+    size_t capacity = 0;        // 已申请的节点总数
+    size_t in_use = 0;          // 正在使用的节点数
+    size_t high_water = 0;      // in_use 的历史最大值
+    size_t chunks = 0;          // 已申请的块数
+};
+
+class TimerNodePool
+{
+public:
+    static constexpr uint32_t kChunkBits = 10;
+    static constexpr uint32_t kChunkSize = 1u << kChunkBits;      // 每块 1024 个节点
+
+    TimerNodePool() : free_list(nullptr) {}
+
+    TimerNodePool(const TimerNodePool &) = delete;
+    TimerNodePool &operator=(const TimerNodePool &) = delete;
+
+    // 取出一个空闲节点，没有空闲节点时申请新的一块
+    TimerNode *Acquire()
+    {
+        if(free_list == nullptr)
+        {
+            Grow();
+        }
+        TimerNode *node = static_cast<TimerNode *>(free_list);
+        free_list = node->next;
+        node->next = nullptr;
+        if(++stats.in_use > stats.high_water)
+        {
+            stats.high_water = stats.in_use;
+        }
+        return node;
+    }
+
+    void Release(TimerNode *node)
+    {
+        node->next = free_list;
+        free_list = node;
+        --stats.in_use;
+    }
+
+    // 按 slot 取节点，slot 越界返回 nullptr
+    TimerNode *Get(uint32_t slot) const
+    {
+        uint32_t chunk = slot >> kChunkBits;
+        if(chunk >= chunks.size())
+        {
+            return nullptr;
+        }
+        return &chunks[chunk][slot & (kChunkSize - 1)];
+    }
+
+    // 预先申请至少 n 个节点，避免运行中扩容
+    void Reserve(size_t n)
+    {
+        while(stats.capacity < n)
+        {
+            Grow();
+        }
+    }
+
+    const TimerPoolStats &Stats() const
+    {
+        return stats;
+    }
+
+private:
+    void Grow()
+    {
+        uint32_t base = static_cast<uint32_t>(chunks.size()) << kChunkBits;
+        chunks.push_back(std::make_unique<TimerNode[]>(kChunkSize));
+        TimerNode *chunk = chunks.back().get();
+        // 逆序入链，保证先取出下标小的节点
+        for(uint32_t i = kChunkSize; i-- > 0; )
+        {
+            chunk[i].slot = base + i;
+            chunk[i].next = free_list;
+            free_list = &chunk[i];
+        }
+        stats.capacity += kChunkSize;
+        ++stats.chunks;
+    }
+
+    std::vector<std::unique_ptr<TimerNode[]>> chunks;
+    TimerLink *free_list;
+    TimerPoolStats stats;
+};
+
+/*
+    定长内存块的空闲链表，给 std::set 之类的节点式容器用：
+    块大小在第一次分配时确定，回收的块留在链表里复用，析构时整批释放
+*/
+class FixedBlockArena
+{
+public:
+    static constexpr size_t kBlocksPerChunk = 1024;
+
+    FixedBlockArena() : block_size(0), free_list(nullptr) {}
+
+    FixedBlockArena(const FixedBlockArena &) = delete;
+    FixedBlockArena &operator=(const FixedBlockArena &) = delete;
+
+    void *Allocate(size_t size)
+    {
+        if(block_size == 0)
+        {
+            block_size = size < sizeof(FreeBlock) ? sizeof(FreeBlock) : size;
+        }
+        if(size > block_size)
+        {
+            return ::operator new(size);    // 不是节点大小的请求，直接走堆
+        }
+        if(free_list == nullptr)
+        {
+            Grow();
+        }
+        FreeBlock *block = free_list;
+        free_list = block->next;
+        return block;
+    }
+
+    void Deallocate(void *p, size_t size)
+    {
+        if(size > block_size)
+        {
+            ::operator delete(p);
+            return;
+        }
+        FreeBlock *block = static_cast<FreeBlock *>(p);
+        block->next = free_list;
+        free_list = block;
+    }
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    void Grow()
+    {
+        size_t stride = (block_size + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+        chunks.push_back(std::make_unique<unsigned char[]>(stride * kBlocksPerChunk + alignof(std::max_align_t)));
+        unsigned char *raw = chunks.back().get();
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) + alignof(std::max_align_t) - 1) & ~(uintptr_t(alignof(std::max_align_t)) - 1);
+        for(size_t i = kBlocksPerChunk; i-- > 0; )
+        {
+            FreeBlock *block = reinterpret_cast<FreeBlock *>(aligned + i * stride);
+            block->next = free_list;
+            free_list = block;
+        }
+    }
+
+    size_t block_size;
+    FreeBlock *free_list;
+    std::vector<std::unique_ptr<unsigned char[]>> chunks;
+};
+
+// 把 FixedBlockArena 包装成标准分配器，单个对象走空闲链表
+template <class T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(FixedBlockArena *arena) : arena(arena) {}
+
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n)
+    {
+        if(n == 1)
+        {
+            return static_cast<T *>(arena->Allocate(sizeof(T)));
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        if(n == 1)
+        {
+            arena->Deallocate(p, sizeof(T));
+            return;
+        }
+        ::operator delete(p);
+    }
+
+    template <class U>
+    bool operator == (const ArenaAllocator<U> &other) const
+    {
+        return arena == other.arena;
+    }
+
+    template <class U>
+    bool operator != (const ArenaAllocator<U> &other) const
+    {
+        return arena != other.arena;
+    }
+
+private:
+    template <class U> friend class ArenaAllocator;
+
+    FixedBlockArena *arena;
+};
+
+#endif
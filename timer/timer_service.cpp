@@ -0,0 +1,50 @@
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <atomic>
+
+#include "timer_service.h"
+
+using namespace std;
+
+/* 分片定时器服务示例：4 个分片线程，外部线程跨线程添加 / 取消任务，回调在分片自己的线程执行 */
+
+int main()
+{
+    TimerService service(4, TimerBackend::Wheel);
+    service.Start();
+
+    atomic<int> fired{0};
+    thread producer([&] {
+        for(uint64_t conn = 0; conn < 8; ++conn)
+        {
+            uint32_t shard = service.ShardFor(conn);
+            auto id = service.Schedule(shard, 100 * (conn + 1), [conn, shard, &fired](const TimerNode &node) {
+                cout << "conn " << conn << " timeout on shard " << shard
+                     << " (current " << TimerShard::Current()->Index() << ") node id:" << node.id << endl;
+                ++fired;
+            });
+            if(conn % 4 == 3)
+            {
+                service.Cancel(id);     // 模拟连接提前关闭
+            }
+        }
+    });
+    producer.join();
+
+    this_thread::sleep_for(chrono::seconds(1));
+
+    // 统计快照可以在任意线程读取
+    for(uint32_t shard = 0; shard < service.ShardCount(); ++shard)
+    {
+        TimerStatsSnapshot stats = service.Shard(shard).LocalTimer().Stats();
+        cout << "shard " << shard << " adds:" << stats.adds << " cancels:" << stats.cancels
+             << " fired:" << stats.fired << " pending:" << stats.pending
+             << " lateness p99(ns):" << stats.lateness.Percentile(0.99)
+             << " callback p99(ns):" << stats.callback.Percentile(0.99) << endl;
+    }
+
+    service.Stop();
+    cout << "fired:" << fired << endl;
+    return 0;
+}
@@ -0,0 +1,422 @@
+#ifndef __TIMER_SERVICE_H__
+#define __TIMER_SERVICE_H__
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "timer.h"
+
+/*
+    分片定时器服务：每个工作线程（一个 epoll loop）一个 Timer 实例
+    1）其他线程通过无锁 MPSC 队列把 添加 / 取消 命令投递到目标分片，eventfd 唤醒分片线程
+    2）回调只在分片自己的线程里执行，Timer 本身不需要任何同步
+    3）命令用 ticket 标识任务，ticket 由投递线程本地生成，不需要等分片回复
+*/
+
+/*
+    Vyukov 侵入式 MPSC 队列：多个生产者 push 只有一次原子交换，单个消费者 pop 无锁
+    T 需要有 std::atomic<T *> next 成员，且可默认构造（用作哨兵）
+*/
+template <class T>
+class MpscQueue
+{
+public:
+    MpscQueue() : head(&stub), tail(&stub)
+    {
+        stub.next.store(nullptr, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    // 任意线程调用
+    void Push(T *node)
+    {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        T *prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // 只能由消费者线程调用；队列为空（或生产者正在 push 中途）时返回 nullptr
+    T *Pop()
+    {
+        T *first = tail;
+        T *next = first->next.load(std::memory_order_acquire);
+        if(first == &stub)
+        {
+            if(next == nullptr)
+            {
+                return nullptr;
+            }
+            tail = next;
+            first = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if(next != nullptr)
+        {
+            tail = next;
+            return first;
+        }
+        if(first != head.load(std::memory_order_acquire))
+        {
+            return nullptr;     // 生产者还没把 next 接上，下次再取
+        }
+        Push(&stub);
+        next = first->next.load(std::memory_order_acquire);
+        if(next != nullptr)
+        {
+            tail = next;
+            return first;
+        }
+        return nullptr;
+    }
+
+private:
+    std::atomic<T *> head;
+    T *tail;
+    T stub;
+};
+
+// 分片任务标识：分片下标 + ticket
+struct ShardTimerId
+{
+    uint32_t shard = 0;
+    uint64_t ticket = 0;    // 0 表示无效
+};
+
+struct TimerCommand
+{
+    enum Type : uint8_t
+    {
+        Add,
+        Cancel,
+        Stop,
+    };
+
+    std::atomic<TimerCommand *> next{nullptr};
+    Type type = Add;
+    uint64_t ticket = 0;
+    std::chrono::steady_clock::time_point deadline;     // 按投递时刻计算的绝对触发时间
+    std::chrono::nanoseconds period{0};
+    TimerNode::Cb func;
+};
+
+class TimerShard
+{
+public:
+    TimerShard(uint32_t index, TimerBackend backend, TimerResolution resolution)
+        : index(index), timer(backend, resolution)
+    {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        int tfd = timer.EnableTimerfd();
+
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = wake_fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, wake_fd, &ev);
+        ev.data.fd = tfd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+    }
+
+    ~TimerShard()
+    {
+        while(TimerCommand *cmd = inbox.Pop())
+        {
+            delete cmd;
+        }
+        close(wake_fd);
+        close(epfd);
+    }
+
+    TimerShard(const TimerShard &) = delete;
+    TimerShard &operator=(const TimerShard &) = delete;
+
+    // 分片线程的主循环，直到收到 Stop 命令
+    void Run()
+    {
+        Current() = this;
+        epoll_event ev[16];
+        running = true;
+        while(running)
+        {
+            int n = epoll_wait(epfd, ev, 16, -1);
+            timer.UpdateNow();
+            for(int i = 0; i < n; ++i)
+            {
+                if(ev[i].data.fd == wake_fd)
+                {
+                    DrainInbox();
+                }
+                else
+                {
+                    timer.HandleTimerfd();
+                }
+            }
+        }
+        Current() = nullptr;
+    }
+
+    // 任意线程调用：投递命令，必要时唤醒分片线程
+    void Post(TimerCommand *cmd)
+    {
+        inbox.Push(cmd);
+        // 分片线程清掉标记之后才会去取队列，这里只有第一个把标记置位的生产者需要写 eventfd
+        if(!wake_pending.exchange(true, std::memory_order_acq_rel))
+        {
+            uint64_t one = 1;
+            ssize_t ret = write(wake_fd, &one, sizeof(one));
+            (void)ret;
+        }
+    }
+
+    // 以下只能在分片线程里调用
+    void AddLocal(uint64_t ticket, std::chrono::steady_clock::time_point deadline,
+                  std::chrono::nanoseconds period, TimerNode::Cb func)
+    {
+        Entry &entry = entries[ticket];
+        entry.func = std::move(func);
+        entry.handle = timer.AddTimerAt(deadline, [this, ticket](const TimerNode &node) { Fire(ticket, node); }, period);
+    }
+
+    bool CancelLocal(uint64_t ticket)
+    {
+        auto iter = entries.find(ticket);
+        if(iter == entries.end())
+        {
+            return false;
+        }
+        bool cancelled = timer.DelTimer(iter->second.handle);
+        if(iter->second.firing)
+        {
+            iter->second.cancelled = true;  // 在自己的回调里取消，回调返回后再删除
+        }
+        else
+        {
+            entries.erase(iter);
+        }
+        return cancelled;
+    }
+
+    Timer &LocalTimer()
+    {
+        return timer;
+    }
+
+    uint32_t Index() const
+    {
+        return index;
+    }
+
+    // 当前线程所属的分片，不是分片线程时为 nullptr
+    static TimerShard *&Current()
+    {
+        static thread_local TimerShard *current = nullptr;
+        return current;
+    }
+
+private:
+    struct Entry
+    {
+        TimerHandle handle;
+        TimerNode::Cb func;
+        bool firing = false;
+        bool cancelled = false;
+    };
+
+    void Fire(uint64_t ticket, const TimerNode &node)
+    {
+        auto iter = entries.find(ticket);
+        if(iter == entries.end())
+        {
+            return;
+        }
+        Entry &entry = iter->second;    // unordered_map 的元素地址在插入时不变
+        entry.firing = true;
+        entry.func(node);
+        entry.firing = false;
+        if(node.period == 0 || entry.cancelled)
+        {
+            entries.erase(ticket);
+        }
+    }
+
+    void DrainInbox()
+    {
+        uint64_t value;
+        ssize_t ret = read(wake_fd, &value, sizeof(value));
+        (void)ret;
+        // 用 exchange 而不是 store：普通 store 可能排到后面 Pop 的 load 之后，生产者读到旧的 true 就不写 eventfd，
+        // 命令一直留在队列里；两边都是读改写，生产者读到 true 时它的 Push 一定对这里之后的 Pop 可见
+        wake_pending.exchange(false, std::memory_order_acq_rel);
+
+        while(TimerCommand *cmd = inbox.Pop())
+        {
+            switch(cmd->type)
+            {
+            case TimerCommand::Add:
+                AddLocal(cmd->ticket, cmd->deadline, cmd->period, std::move(cmd->func));
+                break;
+            case TimerCommand::Cancel:
+                CancelLocal(cmd->ticket);
+                break;
+            case TimerCommand::Stop:
+                running = false;
+                break;
+            }
+            delete cmd;
+        }
+    }
+
+    uint32_t index;
+    Timer timer;
+    int epfd;
+    int wake_fd;
+    bool running = false;
+    std::atomic<bool> wake_pending{false};
+    MpscQueue<TimerCommand> inbox;
+    std::unordered_map<uint64_t, Entry> entries;    // ticket -> 任务，只在分片线程访问
+};
+
+class TimerService
+{
+public:
+    explicit TimerService(size_t shard_count,
+                          TimerBackend backend = TimerBackend::Set,
+                          TimerResolution resolution = TimerResolution::Milli)
+    {
+        for(size_t i = 0; i < shard_count; ++i)
+        {
+            shards.push_back(std::make_unique<TimerShard>(static_cast<uint32_t>(i), backend, resolution));
+        }
+    }
+
+    ~TimerService()
+    {
+        Stop();
+    }
+
+    TimerService(const TimerService &) = delete;
+    TimerService &operator=(const TimerService &) = delete;
+
+    // 每个分片启动一个线程运行自己的 loop
+    void Start()
+    {
+        for(auto &shard : shards)
+        {
+            TimerShard *ptr = shard.get();
+            threads.emplace_back([ptr] { ptr->Run(); });
+        }
+    }
+
+    void Stop()
+    {
+        for(size_t i = 0; i < threads.size(); ++i)
+        {
+            TimerCommand *cmd = new TimerCommand;
+            cmd->type = TimerCommand::Stop;
+            shards[i]->Post(cmd);
+        }
+        for(auto &thread : threads)
+        {
+            thread.join();
+        }
+        threads.clear();
+    }
+
+    size_t ShardCount() const
+    {
+        return shards.size();
+    }
+
+    // 按 key（例如连接 fd）选择分片
+    uint32_t ShardFor(uint64_t key) const
+    {
+        return static_cast<uint32_t>(key % shards.size());
+    }
+
+    /*
+        任意线程调用：在 shard 上添加任务，period 为 0 表示一次性任务
+        在分片自己的线程里调用时直接操作本地 Timer，不走队列
+        shard 越界时不添加，返回 ticket 为 0 的无效 id
+    */
+    template <class Rep1, class Period1, class Rep2 = int64_t, class Period2 = std::nano>
+    ShardTimerId Schedule(uint32_t shard, std::chrono::duration<Rep1, Period1> delay, TimerNode::Cb func,
+                          std::chrono::duration<Rep2, Period2> period = std::chrono::nanoseconds(0))
+    {
+        if(shard >= shards.size())
+        {
+            return ShardTimerId{shard, 0};
+        }
+        ShardTimerId id{shard, NextTicket()};
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::nanoseconds>(delay);
+        auto period_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(period);
+        TimerShard *target = shards[shard].get();
+        if(TimerShard::Current() == target)
+        {
+            target->AddLocal(id.ticket, deadline, period_ns, std::move(func));
+            return id;
+        }
+        TimerCommand *cmd = new TimerCommand;
+        cmd->type = TimerCommand::Add;
+        cmd->ticket = id.ticket;
+        cmd->deadline = deadline;
+        cmd->period = period_ns;
+        cmd->func = std::move(func);
+        target->Post(cmd);
+        return id;
+    }
+
+    ShardTimerId Schedule(uint32_t shard, time_t msec, TimerNode::Cb func, time_t period_msec = 0)
+    {
+        return Schedule(shard, std::chrono::milliseconds(msec), std::move(func), std::chrono::milliseconds(period_msec));
+    }
+
+    // 任意线程调用：取消任务。跨线程时只是投递命令，任务可能在命令到达前已经触发
+    void Cancel(ShardTimerId id)
+    {
+        if(id.ticket == 0 || id.shard >= shards.size())
+        {
+            return;
+        }
+        TimerShard *target = shards[id.shard].get();
+        if(TimerShard::Current() == target)
+        {
+            target->CancelLocal(id.ticket);
+            return;
+        }
+        TimerCommand *cmd = new TimerCommand;
+        cmd->type = TimerCommand::Cancel;
+        cmd->ticket = id.ticket;
+        target->Post(cmd);
+    }
+
+    TimerShard &Shard(uint32_t shard)
+    {
+        return *shards[shard];
+    }
+
+private:
+    // ticket = 线程序号(高 24 位) | 线程内计数(低 40 位)，各线程独立生成，不共享计数器
+    static uint64_t NextTicket()
+    {
+        static std::atomic<uint64_t> thread_seq{1};
+        static thread_local uint64_t prefix = thread_seq.fetch_add(1, std::memory_order_relaxed) << 40;
+        static thread_local uint64_t counter = 0;
+        return prefix | (++counter & ((uint64_t(1) << 40) - 1));
+    }
+
+    std::vector<std::unique_ptr<TimerShard>> shards;
+    std::vector<std::thread> threads;
+};
+
+#endif
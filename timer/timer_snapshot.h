@@ -0,0 +1,165 @@
+#ifndef __TIMER_SNAPSHOT_H__
+#define __TIMER_SNAPSHOT_H__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include "timer_engine.h"
+
+/*
+    持久化任务的快照：
+    1）回调不能序列化，持久化任务登记的是类型编号（tag）+ 一段 payload，回调由 TimerTypeRegistry 按 tag 查出，
+       保存前和恢复后执行的是同一个处理函数
+    2）触发时间按墙上时间（system_clock 纳秒）保存，重启后换算回新进程的 steady_clock，停机期间已经过期的任务恢复后立即触发
+    3）格式：
+        "TMSN" | version(1 字节) | 任务数(varint) | 保存时的墙上时间(varint)
+        每个任务：触发时间与上一个的差(zigzag varint) | id | tag | 周期 ns | slack ns（均为 varint）| flags(1 字节) | payload 长度(varint) + 内容
+       任务按触发时间排序，时间差通常只有几个字节
+*/
+
+class TimerTypeRegistry
+{
+public:
+    using Handler = SmallFunction<void(const TimerNode &node, const std::string &payload)>;
+
+    // tag 0 保留给非持久化任务；同一个 tag 只能登记一次
+    bool Register(uint32_t tag, Handler handler)
+    {
+        if(tag == 0)
+        {
+            return false;
+        }
+        return handlers.emplace(tag, std::move(handler)).second;
+    }
+
+    // unordered_map 的元素地址在插入新元素后不变，Timer 可以一直持有返回的指针
+    const Handler *Find(uint32_t tag) const
+    {
+        auto it = handlers.find(tag);
+        return it == handlers.end() ? nullptr : &it->second;
+    }
+
+private:
+    std::unordered_map<uint32_t, Handler> handlers;
+};
+
+class SnapshotWriter
+{
+public:
+    explicit SnapshotWriter(std::string &out) : out(out) {}
+
+    void Byte(uint8_t value)
+    {
+        out.push_back(static_cast<char>(value));
+    }
+
+    // 先编码到栈上再整段追加，比逐字节 push_back 快
+    void Varint(uint64_t value)
+    {
+        char buffer[10];
+        size_t n = 0;
+        while(value >= 0x80)
+        {
+            buffer[n++] = static_cast<char>((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        buffer[n++] = static_cast<char>(value);
+        out.append(buffer, n);
+    }
+
+    // 有符号数先做 zigzag，绝对值小的负数也只占一两个字节
+    void Signed(int64_t value)
+    {
+        Varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    void Bytes(const char *data, size_t size)
+    {
+        out.append(data, size);
+    }
+
+private:
+    std::string &out;
+};
+
+// 读失败后 Ok() 一直返回 false，调用者读完一段再检查一次即可
+class SnapshotReader
+{
+public:
+    SnapshotReader(const char *data, size_t size) : pos(data), end(data + size) {}
+
+    bool Ok() const
+    {
+        return ok;
+    }
+
+    bool AtEnd() const
+    {
+        return pos == end;
+    }
+
+    uint8_t Byte()
+    {
+        if(pos == end)
+        {
+            ok = false;
+            return 0;
+        }
+        return static_cast<uint8_t>(*pos++);
+    }
+
+    uint64_t Varint()
+    {
+        uint64_t value = 0;
+        for(int shift = 0; shift < 64; shift += 7)
+        {
+            if(pos == end)
+            {
+                break;
+            }
+            uint8_t byte = static_cast<uint8_t>(*pos++);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if(!(byte & 0x80))
+            {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    int64_t Signed()
+    {
+        uint64_t value = Varint();
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    // 返回指向缓冲区内部的指针，不拷贝
+    const char *Bytes(size_t size)
+    {
+        if(static_cast<size_t>(end - pos) < size)
+        {
+            ok = false;
+            return nullptr;
+        }
+        const char *data = pos;
+        pos += size;
+        return data;
+    }
+
+private:
+    const char *pos;
+    const char *end;
+    bool ok = true;
+};
+
+constexpr char kTimerSnapshotMagic[4] = {'T', 'M', 'S', 'N'};
+constexpr uint8_t kTimerSnapshotVersion = 1;
+
+// 单个任务的 flags
+constexpr uint8_t kSnapshotCatchUp = 1 << 0;    // miss_policy == CatchUp
+constexpr uint8_t kSnapshotOffload = 1 << 1;
+
+#endif
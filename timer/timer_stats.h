@@ -0,0 +1,191 @@
+#ifndef __TIMER_STATS_H__
+#define __TIMER_STATS_H__
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/*
+    定时器的运行统计：计数器 + HDR 风格的对数直方图
+    1）只有定时器所在的 loop 线程写，写入是 relaxed 的 load + store，没有锁也没有原子 RMW，开销和普通自增一样
+    2）任意线程都可以拿快照，每个计数单独读是完整的，整体不保证是同一时刻的（监控够用）
+    3）直方图按 2 的幂分段，每段再等分 16 格，相对误差不超过 1/16，覆盖 0 ~ 2^64 纳秒
+*/
+
+// 单写者计数器加一
+inline void StatsBump(std::atomic<uint64_t> &counter, uint64_t n = 1)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+class HistogramSnapshot
+{
+public:
+    static constexpr int kSubBits = 4;
+    static constexpr int kSubCount = 1 << kSubBits;
+    static constexpr int kBuckets = (64 - kSubBits + 1) * kSubCount;
+
+    static int BucketOf(uint64_t value)
+    {
+        if(value < kSubCount)
+        {
+            return static_cast<int>(value);
+        }
+        int magnitude = 63 - __builtin_clzll(value);
+        int sub = static_cast<int>((value >> (magnitude - kSubBits)) & (kSubCount - 1));
+        return (magnitude - kSubBits + 1) * kSubCount + sub;
+    }
+
+    // 格子的下界
+    static uint64_t BucketValue(int bucket)
+    {
+        if(bucket < kSubCount)
+        {
+            return static_cast<uint64_t>(bucket);
+        }
+        int magnitude = bucket / kSubCount + kSubBits - 1;
+        uint64_t sub = static_cast<uint64_t>(bucket % kSubCount);
+        return (kSubCount + sub) << (magnitude - kSubBits);
+    }
+
+    uint64_t Count() const
+    {
+        return count;
+    }
+
+    uint64_t Max() const
+    {
+        return max;
+    }
+
+    double Mean() const
+    {
+        return count == 0 ? 0.0 : static_cast<double>(sum) / count;
+    }
+
+    // p 取 0 ~ 1，返回所在格子的下界
+    uint64_t Percentile(double p) const
+    {
+        if(count == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p * count);
+        if(rank >= count)
+        {
+            rank = count - 1;
+        }
+        uint64_t seen = 0;
+        for(int i = 0; i < kBuckets; ++i)
+        {
+            seen += buckets[i];
+            if(seen > rank)
+            {
+                return BucketValue(i);
+            }
+        }
+        return max;
+    }
+
+    // 两次快照相减，得到这段时间内的分布
+    HistogramSnapshot Since(const HistogramSnapshot &earlier) const
+    {
+        HistogramSnapshot diff = *this;
+        diff.count -= earlier.count;
+        diff.sum -= earlier.sum;
+        for(int i = 0; i < kBuckets; ++i)
+        {
+            diff.buckets[i] -= earlier.buckets[i];
+        }
+        return diff;
+    }
+
+private:
+    friend class LatencyHistogram;
+
+    std::array<uint64_t, kBuckets> buckets{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;       // 历史最大值，Since() 不做差
+};
+
+// 写入端，只能在一个线程里 Record
+class LatencyHistogram
+{
+public:
+    void Record(uint64_t value)
+    {
+        StatsBump(buckets[HistogramSnapshot::BucketOf(value)]);
+        StatsBump(count);
+        StatsBump(sum, value);
+        if(value > max.load(std::memory_order_relaxed))
+        {
+            max.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    void Snapshot(HistogramSnapshot &out) const
+    {
+        for(int i = 0; i < HistogramSnapshot::kBuckets; ++i)
+        {
+            out.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+        }
+        out.count = count.load(std::memory_order_relaxed);
+        out.sum = sum.load(std::memory_order_relaxed);
+        out.max = max.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::kBuckets> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> max{0};
+};
+
+// 某一时刻的统计快照，计数都是累计值，两次快照相减得到速率
+struct TimerStatsSnapshot
+{
+    uint64_t time_ns = 0;       // 拍快照的 steady_clock 时间
+    uint64_t adds = 0;
+    uint64_t cancels = 0;
+    uint64_t resets = 0;        // ResetTimer / ExtendTimer
+    uint64_t fired = 0;         // 执行的回调次数
+    uint64_t pending = 0;       // 等待触发的任务数
+    HistogramSnapshot lateness;     // 实际执行时间 - expire，纳秒
+    HistogramSnapshot callback;     // 回调耗时，纳秒
+
+    // 相对较早的一次快照，每秒的次数
+    double PerSecond(uint64_t TimerStatsSnapshot::*field, const TimerStatsSnapshot &earlier) const
+    {
+        if(time_ns <= earlier.time_ns)
+        {
+            return 0.0;
+        }
+        return static_cast<double>(this->*field - earlier.*field) * 1e9 / (time_ns - earlier.time_ns);
+    }
+};
+
+// Timer 内部持有的统计
+struct TimerStats
+{
+    std::atomic<uint64_t> adds{0};
+    std::atomic<uint64_t> cancels{0};
+    std::atomic<uint64_t> resets{0};
+    std::atomic<uint64_t> fired{0};
+    std::atomic<uint64_t> pending{0};
+    LatencyHistogram lateness;
+    LatencyHistogram callback;
+
+    void Snapshot(TimerStatsSnapshot &out) const
+    {
+        out.adds = adds.load(std::memory_order_relaxed);
+        out.cancels = cancels.load(std::memory_order_relaxed);
+        out.resets = resets.load(std::memory_order_relaxed);
+        out.fired = fired.load(std::memory_order_relaxed);
+        out.pending = pending.load(std::memory_order_relaxed);
+        lateness.Snapshot(out.lateness);
+        callback.Snapshot(out.callback);
+    }
+};
+
+#endif
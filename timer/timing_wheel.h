@@ -0,0 +1,323 @@
+#ifndef __TIMING_WHEEL_H__
+#define __TIMING_WHEEL_H__
+
+#include <limits>
+#include <cstdint>
+
+#include "timer_engine.h"
+
+/*
+    分层时间轮引擎，插入、删除 O(1)，节点通过 TimerLink 侵入式地挂在格子上
+    一格 = 2^shift 个 tick（毫秒 / 微秒精度下 shift = 0），共 5 层，低层转满一圈时把高层对应格子里的任务"降级"（cascade）到低层：
+        第 0 层  256 格 x 1ms     ≈ 256ms   （毫秒级）
+        第 1 层   64 格 x 256ms   ≈ 16s     （秒级）
+        第 2 层   64 格 x 16s     ≈ 17min   （分钟级）
+        第 3 层   64 格 x 17min   ≈ 18h
+        第 4 层   64 格 x 18h     ≈ 49 天，更远的任务先放在最后一格，降级时重新计算位置
+    （以上是 1 格 = 1ms 时的跨度。）任务的 expire 向上取整到格子边界，只会推迟不超过一格，不会提前触发。
+    每层用位图记录非空的格子，推进时间时直接跳到下一个有事件的 tick，空转的 tick 不需要逐个走。
+    推迟触发时间（续期）时节点留在原来的格子里，只改 expire，格子到期或降级时再按新时间重新放置。
+*/
+
+class TimingWheelEngine : public TimerEngine
+{
+public:
+    static constexpr int kRootBits = 8;
+    static constexpr int kLevelBits = 6;
+    static constexpr int kLevels = 4;       // 除第 0 层以外的层数
+    static constexpr int kRootSize = 1 << kRootBits;
+    static constexpr int kLevelSize = 1 << kLevelBits;
+    static constexpr int kSlots = kRootSize + kLevels * kLevelSize;
+    static constexpr int kOverdue = kSlots;     // 添加时就已经过期的任务，不占位图
+
+    TimingWheelEngine(time_t now, int shift = 0)
+        : shift(shift), current(now >> shift), count(0)
+        {
+            for(int i = 0; i <= kSlots; ++i)
+            {
+                slots[i].prev = slots[i].next = &slots[i];
+            }
+            for(auto &word : bitmap)
+            {
+                word = 0;
+            }
+        }
+
+    TimingWheelEngine(const TimingWheelEngine &) = delete;
+    TimingWheelEngine &operator=(const TimingWheelEngine &) = delete;
+
+    void Insert(TimerNode *node) override
+    {
+        Place(node);
+        ++count;
+    }
+
+    void Erase(TimerNode *node) override
+    {
+        Unlink(node);
+        --count;
+    }
+
+    // 提前：立即移到新的格子；推迟：什么都不动，Drain 时发现还没到期再重新放置
+    void Update(TimerNode *node, time_t expire) override
+    {
+        bool earlier = expire < node->expire;
+        node->expire = expire;
+        if(earlier)
+        {
+            Unlink(node);
+            Place(node);
+        }
+    }
+
+    void CollectExpired(time_t now_tick, std::vector<TimerNode *> &out) override
+    {
+        time_t now = now_tick >> shift;
+        Drain(kOverdue, current - 1, out);
+        while(count > 0)
+        {
+            time_t tick = NextEventTick();
+            if(tick > now)
+            {
+                break;
+            }
+            current = tick;
+            if((tick & (kRootSize - 1)) == 0)
+            {
+                Cascade();
+            }
+            Drain(static_cast<int>(tick & (kRootSize - 1)), tick, out);
+            current = tick + 1;
+        }
+        if(current <= now)
+        {
+            current = now + 1;
+        }
+    }
+
+    time_t NearestExpire() const override
+    {
+        if(count == 0)
+        {
+            return -1;
+        }
+        if(slots[kOverdue].next != &slots[kOverdue])
+        {
+            return (current - 1) << shift;
+        }
+        return NextEventTick() << shift;
+    }
+
+    size_t Size() const override
+    {
+        return count;
+    }
+
+private:
+    static int LevelShift(int level)
+    {
+        return kRootBits + (level - 1) * kLevelBits;
+    }
+
+    // 按照相对 current 的距离决定任务落在哪一层哪一格
+    // expire 向上取整到格子时间
+    time_t SlotTime(time_t expire) const
+    {
+        return (expire + (time_t(1) << shift) - 1) >> shift;
+    }
+
+    void Place(TimerNode *node)
+    {
+        time_t expire = SlotTime(node->expire);
+        time_t delta = expire - current;
+        int slot;
+        if(delta < 0)
+        {
+            slot = kOverdue;    // 已经过期，下次 Expire 直接执行
+        }
+        else if(delta < kRootSize)
+        {
+            slot = static_cast<int>(expire & (kRootSize - 1));
+        }
+        else
+        {
+            if(static_cast<uint64_t>(delta) > std::numeric_limits<uint32_t>::max())
+            {
+                expire = current + std::numeric_limits<uint32_t>::max();
+            }
+            int level = 1;
+            while(level < kLevels && delta >= (time_t(1) << LevelShift(level + 1)))
+            {
+                ++level;
+            }
+            slot = kRootSize + (level - 1) * kLevelSize
+                 + static_cast<int>((expire >> LevelShift(level)) & (kLevelSize - 1));
+        }
+
+        node->bucket = static_cast<uint16_t>(slot);
+        TimerLink &head = slots[slot];
+        node->prev = head.prev;
+        node->next = &head;
+        head.prev->next = node;
+        head.prev = node;
+        if(slot != kOverdue)
+        {
+            bitmap[slot >> 6] |= uint64_t(1) << (slot & 63);
+        }
+    }
+
+    void Unlink(TimerNode *node)
+    {
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->prev = node->next = nullptr;
+        TimerLink &head = slots[node->bucket];
+        if(head.next == &head && node->bucket != kOverdue)
+        {
+            bitmap[node->bucket >> 6] &= ~(uint64_t(1) << (node->bucket & 63));
+        }
+    }
+
+    // 把整格链表转移到 out 上，并清掉位图
+    void Splice(int slot, TimerLink &out)
+    {
+        TimerLink &head = slots[slot];
+        if(head.next == &head)
+        {
+            out.prev = out.next = &out;
+            return;
+        }
+        out.next = head.next;
+        out.prev = head.prev;
+        out.next->prev = &out;
+        out.prev->next = &out;
+        head.prev = head.next = &head;
+        if(slot != kOverdue)
+        {
+            bitmap[slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+        }
+    }
+
+
+    /*
+        整格摘下，到期（格子时间 <= due）的节点依次追加到 out，格子一次性清空
+        被推迟过的节点还没到期，重新放置，一定落在别的格子里
+    */
+    void Drain(int slot, time_t due, std::vector<TimerNode *> &out)
+    {
+        TimerLink &head = slots[slot];
+        for(TimerLink *link = head.next; link != &head; )
+        {
+            TimerNode *node = static_cast<TimerNode *>(link);
+            link = link->next;
+            if(SlotTime(node->expire) > due)
+            {
+                Place(node);
+                continue;
+            }
+            node->prev = node->next = nullptr;
+            out.push_back(node);
+            --count;
+        }
+        head.prev = head.next = &head;
+        if(slot != kOverdue)
+        {
+            bitmap[slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+        }
+    }
+
+    // 第 0 层转满一圈，把上一层对应格子重新分配；若上一层也走到 0 格，继续向上
+    void Cascade()
+    {
+        for(int level = 1; level <= kLevels; ++level)
+        {
+            int idx = static_cast<int>((current >> LevelShift(level)) & (kLevelSize - 1));
+            TimerLink moved;
+            Splice(kRootSize + (level - 1) * kLevelSize + idx, moved);
+            while(moved.next != &moved)
+            {
+                TimerNode *node = static_cast<TimerNode *>(moved.next);
+                moved.next = node->next;
+                node->next->prev = &moved;
+                Place(node);
+            }
+            if(idx != 0)
+            {
+                break;
+            }
+        }
+    }
+
+    // 在 [from, from + 64) 范围内循环查找第一个置位的 bit，返回相对 from 的距离，没有返回 -1
+    static int FirstSetFrom(uint64_t word, int from)
+    {
+        if(word == 0)
+        {
+            return -1;
+        }
+        uint64_t rotated = from == 0 ? word : (word >> from) | (word << (64 - from));
+        return __builtin_ctzll(rotated);
+    }
+
+    // 第 0 层从 from 开始循环查找第一个非空格子，返回距离，没有返回 -1
+    int RootDistance(int from) const
+    {
+        int word = from >> 6;
+        int bit = from & 63;
+        uint64_t bits = bitmap[word] & (~uint64_t(0) << bit);
+        if(bits)
+        {
+            return word * 64 + __builtin_ctzll(bits) - from;
+        }
+        for(int i = 1; i <= kRootSize / 64; ++i)
+        {
+            int w = (word + i) & (kRootSize / 64 - 1);
+            bits = bitmap[w];
+            if(w == word)
+            {
+                bits &= (bit == 0) ? 0 : (uint64_t(1) << bit) - 1;    // 绕回来只看 from 之前的位
+            }
+            if(bits)
+            {
+                return (w * 64 + __builtin_ctzll(bits) - from) & (kRootSize - 1);
+            }
+        }
+        return -1;
+    }
+
+    // 下一个需要处理的 tick：第 0 层是精确的触发时间，高层是降级发生的时间（触发时间的下界）
+    time_t NextEventTick() const
+    {
+        time_t best = std::numeric_limits<time_t>::max();
+
+        int dist = RootDistance(static_cast<int>(current & (kRootSize - 1)));
+        if(dist >= 0)
+        {
+            best = current + dist;
+        }
+
+        for(int level = 1; level <= kLevels; ++level)
+        {
+            int shift = LevelShift(level);
+            time_t base = (current + (time_t(1) << shift) - 1) >> shift;
+            int dist = FirstSetFrom(bitmap[(kRootSize >> 6) + level - 1], static_cast<int>(base & (kLevelSize - 1)));
+            if(dist >= 0)
+            {
+                time_t tick = (base + dist) << shift;
+                if(tick < best)
+                {
+                    best = tick;
+                }
+            }
+        }
+        return best;
+    }
+
+    TimerLink slots[kSlots + 1];
+    uint64_t bitmap[kSlots / 64];
+    int shift;              // 一格 = 2^shift 个 tick
+    time_t current;         // 下一个待处理的格子时间（tick >> shift）
+    size_t count;
+};
+
+#endif
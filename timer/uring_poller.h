@@ -0,0 +1,475 @@
+#ifndef __URING_POLLER_H__
+#define __URING_POLLER_H__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <endian.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "poller.h"
+
+/*
+    基于 io_uring 的 Poller，直接用系统调用，不依赖 liburing：
+    1）fd 用 IORING_OP_POLL_ADD 监听。水平触发用单次 poll，事件处理完后在下一次 Wait 重新提交，
+       没读完的 fd 重新提交后立即完成，效果和 epoll 的水平触发一样；边缘触发用多次触发的 poll（IORING_POLL_ADD_MULTI）
+    2）定时器的截止时间用 IORING_OP_TIMEOUT（CLOCK_MONOTONIC 绝对时间）提交，截止时间不变就不重新提交
+    3）每次 Wait 只进一次 io_uring_enter：重新提交的 poll、超时一起提交，同时等待完成事件，完成事件批量从 CQ 里取
+    内核不支持（没有 io_uring、被 seccomp 禁用、缺少需要的操作）时 Ok() 返回 false，由 Reactor 退回 epoll
+    只能在一个线程里使用
+*/
+
+class IoUringPoller : public Poller
+{
+public:
+    explicit IoUringPoller(size_t max_events)
+    {
+        unsigned entries = 64;
+        while(entries < max_events && entries < 4096)
+        {
+            entries <<= 1;
+        }
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if(ring_fd < 0)
+        {
+            return;
+        }
+        // 没有 NODROP 时 CQ 满了会丢事件
+        if(!(params.features & IORING_FEAT_NODROP) || !MapRings(params) || !Probe())
+        {
+            Close();
+        }
+    }
+
+    ~IoUringPoller() override
+    {
+        Close();
+    }
+
+    IoUringPoller(const IoUringPoller &) = delete;
+    IoUringPoller &operator=(const IoUringPoller &) = delete;
+
+    bool Ok() const
+    {
+        return ring_fd >= 0;
+    }
+
+    PollerBackend Backend() const override
+    {
+        return PollerBackend::IoUring;
+    }
+
+    bool Add(int fd, uint64_t data, uint32_t interest, bool edge) override
+    {
+        if(fd < 0 || fcntl(fd, F_GETFD) < 0)
+        {
+            return false;
+        }
+        if(static_cast<size_t>(fd) >= states.size())
+        {
+            states.resize(fd + 1);
+        }
+        FdState &state = states[fd];
+        if(state.registered)
+        {
+            return false;
+        }
+        state.registered = true;
+        Set(state, data, interest, edge);
+        ArmPoll(fd, state);
+        return true;
+    }
+
+    bool Modify(int fd, uint64_t data, uint32_t interest, bool edge) override
+    {
+        FdState *state = Find(fd);
+        if(state == nullptr)
+        {
+            return false;
+        }
+        CancelPoll(*state);
+        Set(*state, data, interest, edge);
+        ArmPoll(fd, *state);
+        return true;
+    }
+
+    void Remove(int fd) override
+    {
+        FdState *state = Find(fd);
+        if(state != nullptr)
+        {
+            CancelPoll(*state);
+            state->registered = false;
+            state->rearm = false;
+        }
+    }
+
+    int Wait(PollEvent *out, int max_events, int64_t deadline_ns) override
+    {
+        FlushRearm();
+        // 已经到期就不用内核超时了，提交之后不阻塞地收一次
+        bool expired = deadline_ns >= 0 && deadline_ns <= ClockNs();
+        ArmTimeout(expired ? -1 : deadline_ns);
+
+        bool timed_out = false;
+        int n = Harvest(out, max_events, timed_out);
+        if(n > 0 || expired)
+        {
+            Enter(0);
+            return n > 0 ? n : Harvest(out, max_events, timed_out);
+        }
+        // 取消 poll / 超时产生的完成事件不算数，继续等
+        while(n == 0 && !timed_out)
+        {
+            if(Enter(1) < 0 && errno != EBUSY)
+            {
+                return 0;   // EINTR
+            }
+            n = Harvest(out, max_events, timed_out);
+        }
+        return n;
+    }
+
+private:
+    // user_data 低 32 位是 fd，高 32 位是 poll 的提交序号；低 32 位是下面两个值时不是 fd
+    static constexpr uint32_t kTimeoutSlot = 0xfffffffe;
+    static constexpr uint32_t kIgnoreSlot = 0xffffffff;
+
+    struct FdState
+    {
+        uint64_t data = 0;
+        uint32_t interest = 0;
+        uint32_t arm = 0;           // 每次提交 poll 加一，和完成事件里的不一致说明是已经取消的 poll
+        bool edge = false;
+        bool registered = false;
+        bool armed = false;         // 有一个 poll 在内核里
+        bool rearm = false;         // 等待下一次 Wait 重新提交
+    };
+
+    static uint64_t Tag(uint32_t seq, uint32_t slot)
+    {
+        return (static_cast<uint64_t>(seq) << 32) | slot;
+    }
+
+    static void Set(FdState &state, uint64_t data, uint32_t interest, bool edge)
+    {
+        state.data = data;
+        state.interest = interest & ~static_cast<uint32_t>(EPOLLET);
+        state.edge = edge;
+        state.rearm = false;
+    }
+
+    FdState *Find(int fd)
+    {
+        if(fd < 0 || static_cast<size_t>(fd) >= states.size() || !states[fd].registered)
+        {
+            return nullptr;
+        }
+        return &states[fd];
+    }
+
+    bool MapRings(const io_uring_params &params)
+    {
+        sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if(single)
+        {
+            sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        }
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if(sq_ring == MAP_FAILED)
+        {
+            sq_ring = nullptr;
+            return false;
+        }
+        if(single)
+        {
+            cq_ring = sq_ring;
+        }
+        else
+        {
+            cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+            if(cq_ring == MAP_FAILED)
+            {
+                cq_ring = nullptr;
+                return false;
+            }
+        }
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqe_map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if(sqe_map == MAP_FAILED)
+        {
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe *>(sqe_map);
+
+        char *sq = static_cast<char *>(sq_ring);
+        sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        sq_entries = params.sq_entries;
+        sq_local_tail = *sq_tail;
+
+        char *cq = static_cast<char *>(cq_ring);
+        cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    // 确认内核支持用到的操作（IORING_REGISTER_PROBE 本身需要 5.6）
+    bool Probe()
+    {
+        const unsigned kOps = 256;
+        std::vector<char> buffer(sizeof(io_uring_probe) + kOps * sizeof(io_uring_probe_op), 0);
+        io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+        if(syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PROBE, probe, kOps) < 0)
+        {
+            return false;
+        }
+        for(unsigned op : {IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE, IORING_OP_TIMEOUT, IORING_OP_TIMEOUT_REMOVE})
+        {
+            if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        if(sqes != nullptr)
+        {
+            munmap(sqes, sqes_size);
+            sqes = nullptr;
+        }
+        if(cq_ring != nullptr && cq_ring != sq_ring)
+        {
+            munmap(cq_ring, cq_ring_size);
+        }
+        cq_ring = nullptr;
+        if(sq_ring != nullptr)
+        {
+            munmap(sq_ring, sq_ring_size);
+            sq_ring = nullptr;
+        }
+        if(ring_fd >= 0)
+        {
+            close(ring_fd);
+            ring_fd = -1;
+        }
+    }
+
+    // SQ 满了先提交一次腾出位置
+    io_uring_sqe *GetSqe()
+    {
+        if(sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries)
+        {
+            Enter(0);
+        }
+        unsigned index = sq_local_tail & sq_mask;
+        io_uring_sqe *sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array[index] = index;
+        ++sq_local_tail;
+        return sqe;
+    }
+
+    // 提交所有还没提交的 SQE，min_complete > 0 时阻塞到至少有这么多完成事件
+    int Enter(unsigned min_complete)
+    {
+        __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+        unsigned to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+        if(to_submit == 0 && min_complete == 0)
+        {
+            return 0;
+        }
+        unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+        return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    void ArmPoll(int fd, FdState &state)
+    {
+        io_uring_sqe *sqe = GetSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+        sqe->poll32_events = (state.interest << 16) | (state.interest >> 16);
+#else
+        sqe->poll32_events = state.interest;
+#endif
+        sqe->len = state.edge && multishot ? IORING_POLL_ADD_MULTI : 0;
+        sqe->user_data = Tag(++state.arm, static_cast<uint32_t>(fd));
+        state.armed = true;
+    }
+
+    // 被取消的 poll 还会产生一个完成事件，序号对不上，收到时丢掉
+    void CancelPoll(FdState &state)
+    {
+        if(!state.armed)
+        {
+            return;
+        }
+        int fd = static_cast<int>(&state - states.data());
+        io_uring_sqe *sqe = GetSqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = Tag(state.arm, static_cast<uint32_t>(fd));
+        sqe->user_data = Tag(0, kIgnoreSlot);
+        state.armed = false;
+    }
+
+    void FlushRearm()
+    {
+        for(int fd : rearm)
+        {
+            FdState *state = Find(fd);
+            if(state != nullptr && state->rearm)
+            {
+                state->rearm = false;
+                ArmPoll(fd, *state);
+            }
+        }
+        rearm.clear();
+    }
+
+    // 内核里最多保留一个超时；截止时间变了就删掉旧的再提交新的，两个 SQE 随下一次 io_uring_enter 一起提交
+    void ArmTimeout(int64_t deadline_ns)
+    {
+        if(deadline_ns == armed_deadline)
+        {
+            return;
+        }
+        if(armed_deadline >= 0)
+        {
+            io_uring_sqe *sqe = GetSqe();
+            sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = Tag(timeout_seq, kTimeoutSlot);
+            sqe->user_data = Tag(0, kIgnoreSlot);
+        }
+        armed_deadline = deadline_ns;
+        if(deadline_ns < 0)
+        {
+            return;
+        }
+        // timespec 在提交时由内核读取，每次 Wait 都会把 SQE 提交掉，所以一个成员就够了
+        timeout_spec.tv_sec = deadline_ns / 1000000000;
+        timeout_spec.tv_nsec = deadline_ns % 1000000000;
+        io_uring_sqe *sqe = GetSqe();
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->fd = -1;
+        sqe->addr = reinterpret_cast<uint64_t>(&timeout_spec);
+        sqe->len = 1;
+        sqe->off = 0;       // 不按完成事件数触发，只看时间
+        sqe->timeout_flags = IORING_TIMEOUT_ABS;
+        sqe->user_data = Tag(++timeout_seq, kTimeoutSlot);
+    }
+
+    // 从 CQ 取完成事件，最多 max_events 个 IO 事件，剩下的留给下一次
+    int Harvest(PollEvent *out, int max_events, bool &timed_out)
+    {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        int n = 0;
+        while(head != tail && n < max_events)
+        {
+            const io_uring_cqe &cqe = cqes[head & cq_mask];
+            ++head;
+            uint32_t slot = static_cast<uint32_t>(cqe.user_data);
+            uint32_t seq = static_cast<uint32_t>(cqe.user_data >> 32);
+            if(slot == kTimeoutSlot)
+            {
+                if(seq == timeout_seq && armed_deadline >= 0)
+                {
+                    armed_deadline = -1;
+                    timed_out = true;
+                }
+                continue;
+            }
+            FdState *state = slot == kIgnoreSlot ? nullptr : Find(static_cast<int>(slot));
+            if(state == nullptr || state->arm != seq || !state->armed)
+            {
+                continue;
+            }
+            bool more = cqe.flags & IORING_CQE_F_MORE;
+            if(!more)
+            {
+                state->armed = false;
+            }
+            if(cqe.res == -EINVAL && state->edge && multishot)
+            {
+                multishot = false;      // 内核不支持多次触发的 poll（5.13 之前），边缘触发退化成单次 poll
+                QueueRearm(static_cast<int>(slot), *state);
+                continue;
+            }
+            if(cqe.res < 0)
+            {
+                out[n].data = state->data;
+                out[n].events = EPOLLERR;
+                ++n;
+                continue;   // fd 出错不再重新提交
+            }
+            if(!more)
+            {
+                QueueRearm(static_cast<int>(slot), *state);
+            }
+            out[n].data = state->data;
+            out[n].events = static_cast<uint32_t>(cqe.res);
+            ++n;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return n;
+    }
+
+    void QueueRearm(int fd, FdState &state)
+    {
+        if(!state.rearm)
+        {
+            state.rearm = true;
+            rearm.push_back(fd);
+        }
+    }
+
+    int ring_fd = -1;
+    void *sq_ring = nullptr;
+    void *cq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    size_t sqes_size = 0;
+    io_uring_sqe *sqes = nullptr;
+
+    unsigned *sq_head = nullptr;
+    unsigned *sq_tail = nullptr;
+    unsigned *sq_array = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned sq_local_tail = 0;     // 已经填好但还没发布给内核的 SQE 也算在内
+
+    unsigned *cq_head = nullptr;
+    unsigned *cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    io_uring_cqe *cqes = nullptr;
+
+    std::vector<FdState> states;    // 按 fd 索引
+    std::vector<int> rearm;
+    bool multishot = true;
+
+    __kernel_timespec timeout_spec = {};
+    int64_t armed_deadline = -1;    // 内核里超时的截止时间，-1 表示没有
+    uint32_t timeout_seq = 0;
+};
+
+#endif
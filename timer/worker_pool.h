@@ -0,0 +1,176 @@
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "small_function.h"
+
+/*
+    工作窃取线程池，用来执行比较重的定时器回调：
+    1）每个工作线程一个任务队列，外部线程投递时轮流放入各队列，工作线程自己投递时放入自己的队列
+    2）工作线程从自己队列的尾部取（刚放进去的任务缓存还是热的），自己的队列空了就从别的队列头部偷
+    3）所有队列都空时在条件变量上睡眠，投递任务时唤醒一个
+    每个队列有自己的锁，只有偷任务时才会碰到别人的锁
+*/
+
+class WorkStealingPool
+{
+public:
+    using Task = SmallFunction<void()>;
+
+    explicit WorkStealingPool(size_t thread_count)
+    {
+        if(thread_count == 0)
+        {
+            thread_count = 1;
+        }
+        for(size_t i = 0; i < thread_count; ++i)
+        {
+            workers.push_back(std::make_unique<Worker>());
+        }
+        for(size_t i = 0; i < thread_count; ++i)
+        {
+            threads.emplace_back([this, i] { Run(i); });
+        }
+    }
+
+    // 已经投递的任务全部执行完才返回
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping = true;
+        }
+        sleep_cv.notify_all();
+        for(auto &thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    // 任意线程调用
+    void Submit(Task task)
+    {
+        size_t index = CurrentIndex() != kNotWorker && CurrentPool() == this
+                     ? CurrentIndex()
+                     : next_queue.fetch_add(1, std::memory_order_relaxed) % workers.size();
+        // 先计数再入队：任务入队后可能马上被取走并减一，先入队的话无符号计数会短暂回绕成 SIZE_MAX，空闲线程误以为有活空转
+        queued.fetch_add(1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(workers[index]->mutex);
+            workers[index]->tasks.push_back(std::move(task));
+        }
+        {
+            // 和睡眠前的检查互斥，避免丢失唤醒
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+        }
+        sleep_cv.notify_one();
+    }
+
+    size_t ThreadCount() const
+    {
+        return workers.size();
+    }
+
+    // 从别的线程偷到的任务数
+    uint64_t Steals() const
+    {
+        return steals.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t kNotWorker = ~size_t(0);
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    static size_t &CurrentIndex()
+    {
+        static thread_local size_t index = kNotWorker;
+        return index;
+    }
+
+    static WorkStealingPool *&CurrentPool()
+    {
+        static thread_local WorkStealingPool *pool = nullptr;
+        return pool;
+    }
+
+    void Run(size_t index)
+    {
+        CurrentIndex() = index;
+        CurrentPool() = this;
+        Task task;
+        for(;;)
+        {
+            if(PopLocal(index, task) || Steal(index, task))
+            {
+                queued.fetch_sub(1, std::memory_order_relaxed);
+                task();
+                task = nullptr;
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            sleep_cv.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if(stopping && queued.load(std::memory_order_acquire) == 0)
+            {
+                break;
+            }
+        }
+        CurrentIndex() = kNotWorker;
+        CurrentPool() = nullptr;
+    }
+
+    bool PopLocal(size_t index, Task &task)
+    {
+        Worker &worker = *workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if(worker.tasks.empty())
+        {
+            return false;
+        }
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+        return true;
+    }
+
+    bool Steal(size_t index, Task &task)
+    {
+        for(size_t i = 1; i < workers.size(); ++i)
+        {
+            Worker &victim = *workers[(index + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if(!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> next_queue{0};
+    std::atomic<size_t> queued{0};      // 所有队列里还没取走的任务数
+    std::atomic<uint64_t> steals{0};
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    bool stopping = false;
+};
+
+#endif